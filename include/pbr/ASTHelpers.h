@@ -18,6 +18,8 @@
 #define TNT_SCAHELPERS_H_H
 
 #include <deque>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 //#include <intermediate.h>
@@ -56,6 +58,25 @@ glslang::TIntermAggregate* getFunctionByNameOnly(const std::string& functionName
 bool isFunctionCalled(const std::string& functionName, TIntermNode& functionNode,
         TIntermNode& rootNode) noexcept;
 
+// Traverse the AST root, collecting every function definition node by glslang mangled signature.
+void getFunctionDefinitions(TIntermNode& root,
+        std::map<std::string, glslang::TIntermAggregate*>& functions) noexcept;
+
+// Follow the call graph from the definition(s) of entryPoint (a name only, e.g: main) and insert
+// the names of all the functions reached, entryPoint included, in functions. Calls to the
+// functions named in skipped are not followed, nor inserted.
+void getReachableFunctions(const std::string& entryPoint, TIntermNode& root,
+        std::set<std::string>& functions, const std::set<std::string>& skipped = {}) noexcept;
+
+// Traverse the node, inserting the names of the fields accessed on values of the struct type
+// named structName. e.g: uv0 for material.uv0 where material is a MaterialVertexInputs.
+void getStructFieldAccesses(TIntermNode& node, const std::string& structName,
+        std::set<std::string>& fields) noexcept;
+
+// Traverse function definition node, inserting the names of its parameters and local variables
+// in names.
+void getLocalVariables(glslang::TIntermAggregate* func, std::set<std::string>& names) noexcept;
+
 // Traverse the function node provided and record all symbol writes operation and all function call
 // involving symbols.
 void traceSymbols(TIntermNode& functionNode, std::deque<pbr::Symbol>& vector);
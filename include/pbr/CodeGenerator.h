@@ -4,81 +4,71 @@
 #include <vector>
 #include <memory>
 
+#include <string.h>
+
 namespace pbr
 {
 
-class CodeNode
+// Builds a program out of lines. Static text (the shader chunks) is referenced, not copied;
+// generated lines are copied once into an arena owned by the generator. ToText() assembles
+// everything into a single, pre-sized buffer.
+class CodeGenerator
 {
 public:
-	virtual ~CodeNode() {}
-
-	virtual bool ExistLine(const std::string& line) const = 0;
+    CodeGenerator();
 
-	virtual void ToText(std::string& text) const = 0;
+	void Line(const std::string& s = "");
+    void LineFmt(const std::string str, ...);
 
-}; // CodeNode
+	// Appends str as one line without copying it, str must outlive the generator (e.g. a string
+	// literal or one of the SHADERS_*_DATA chunks). lines is the number of '\n' in str, pass it
+	// when known to skip counting them.
+	void Chunk(const char* str, size_t size, size_t lines);
+	void Chunk(const char* str, size_t size) { Chunk(str, size, CountLines(str, size)); }
+	void Chunk(const char* str) { Chunk(str, strlen(str)); }
 
-class CodeLine : public CodeNode
-{
-public:
-	CodeLine(const std::string& line) : m_str(line) {}
+	// Appends the lines of gen, indented at the current level.
+	void Block(CodeGenerator& gen);
 
-	virtual bool ExistLine(const std::string& line) const override {
-		return m_str == line;
-	}
+	bool ExistLine(const std::string& line) const;
 
-	virtual void ToText(std::string& text) const override {
-		text += m_str + "\n";
-	}
+	void Tab();
+	void DeTab();
 
-private:
-	std::string m_str;
+	std::string ToText() const;
 
-}; // CodeLine
+	// Number of lines ToText() would currently return, i.e. its count of '\n'. O(1).
+	size_t GetLineCount() const { return m_line_count; }
 
-class CodeBlock : public CodeNode
-{
-public:
-	virtual bool ExistLine(const std::string& line) const override;
+	static size_t CountLines(const char* str, size_t size);
 
-	virtual void ToText(std::string& text) const override;
+private:
+	struct Piece
+	{
+		const char* str;
+		size_t size;
+		bool newline;   // false for the indentation emitted in front of a Block() line
+	};
 
-	void Add(const std::shared_ptr<CodeNode>& node) {
-		m_children.push_back(node);
-	}
+	char* Allocate(size_t size);
 
-	void SetHeader(const std::string& header) {
-		m_header = header;
+	void AddPiece(const char* str, size_t size, bool newline) {
+		m_pieces.push_back({ str, size, newline });
 	}
 
 private:
-	std::vector<std::shared_ptr<CodeNode>> m_children;
+	std::vector<Piece> m_pieces;
 
-	std::string m_header;
-
-}; // CodeBlock
-
-class CodeGenerator
-{
-public:
-    CodeGenerator();
+	// arena for the generated lines, shared with the generators this one was Block()'ed into
+	std::vector<std::shared_ptr<char>> m_arena;
+	char*  m_arena_block = nullptr;
+	size_t m_arena_used = 0;
+	size_t m_arena_size = 0;
 
-	void Line(const std::string& s = "");
-    void LineFmt(const std::string str, ...);
-	void Block(CodeGenerator& gen);
-
-	bool ExistLine(const std::string& line) const;
-
-	void Tab();
-	void DeTab();
-
-	std::string ToText() const;
-
-private:
-	std::shared_ptr<CodeBlock> m_block = nullptr;
+	size_t m_line_count = 0;
 
 	std::string m_header;
 
 }; // CodeGenerator
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace pbr
+{
+
+struct MaterialInfo;
+
+enum class DescriptorType : uint8_t {
+    UNIFORM_BUFFER,             // VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+    COMBINED_IMAGE_SAMPLER,     // VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+};
+
+// Same values as VkShaderStageFlagBits.
+enum DescriptorStage : uint8_t {
+    STAGE_VERTEX   = 0x1,
+    STAGE_FRAGMENT = 0x10,
+};
+
+struct DescriptorBinding {
+    uint32_t binding;
+    DescriptorType type;
+    uint8_t stages;             // DescriptorStage bits
+
+    bool operator==(const DescriptorBinding& other) const noexcept {
+        return binding == other.binding && type == other.type && stages == other.stages;
+    }
+};
+
+// Bindings of a descriptor set, in binding order, one descriptor each. Maps one to one to a
+// VkDescriptorSetLayoutCreateInfo.
+struct DescriptorSetLayout {
+    uint32_t set = 0;
+    std::vector<DescriptorBinding> bindings;
+
+    uint64_t GetHash() const noexcept;
+
+    // e.g. "set 1: 0 sampler f, 9 sampler vf"
+    void Print(std::ostream& out) const;
+
+    bool operator==(const DescriptorSetLayout& other) const noexcept {
+        return set == other.set && bindings == other.bindings;
+    }
+};
+
+// The descriptor sets the Vulkan programs of a material are generated against, see
+// ShaderGenerator::generateUniforms() and generateSamplers(): set 0 holds the uniform blocks at
+// their BindingPoints, set 1 the samplers at their global offsets. The layout covers every
+// variant, bindings a variant doesn't use (e.g. the bones without skinning) are still declared,
+// so that all the variants of a material share one pipeline layout.
+class DescriptorLayout
+{
+public:
+    static constexpr uint32_t UNIFORM_SET = 0;
+    static constexpr uint32_t SAMPLER_SET = 1;
+    static constexpr uint32_t SET_COUNT   = 2;
+
+    explicit DescriptorLayout(const MaterialInfo& material) noexcept;
+
+    const DescriptorSetLayout& GetSet(uint32_t set) const noexcept { return mSets[set]; }
+
+private:
+    DescriptorSetLayout mSets[SET_COUNT];
+
+}; // DescriptorLayout
+
+// Gives identical set layouts the same id, so that a runtime creates one VkDescriptorSetLayout
+// per id and reuses it across materials. Safe to use from several threads.
+class DescriptorLayoutCache
+{
+public:
+    uint32_t GetId(const DescriptorSetLayout& layout);
+
+    // The reference stays valid as long as the cache.
+    const DescriptorSetLayout& GetLayout(uint32_t id) const;
+
+    size_t GetSize() const;
+
+private:
+    mutable std::mutex mLock;
+    std::unordered_multimap<uint64_t, uint32_t> mIds;
+    std::deque<DescriptorSetLayout> mLayouts;
+
+}; // DescriptorLayoutCache
+
+}
@@ -185,9 +185,10 @@ enum class Precision : uint8_t {
 
 //! Texture sampler type
 enum class SamplerType : uint8_t {
-    SAMPLER_2D,         //!< 2D or 2D array texture
+    SAMPLER_2D,         //!< 2D texture
     SAMPLER_CUBEMAP,    //!< Cube map texture
     SAMPLER_EXTERNAL,   //!< External texture
+    SAMPLER_2D_ARRAY,   //!< 2D array texture
 };
 
 enum class SamplerFormat : uint8_t {
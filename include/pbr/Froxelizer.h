@@ -0,0 +1,156 @@
+#pragma once
+
+#include "pbr/EngineEnums.h"
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace pbr
+{
+
+class ThreadPool;
+
+// CPU side of the punctual lights of light_punctual.fs. Assigns the point and spot lights to the
+// froxels, the cells of a grid over the view frustum, and writes the two textures the shader
+// reads:
+//   light_froxels, RG16UI, FROXEL_BUFFER_WIDTH x FROXEL_BUFFER_HEIGHT: for each froxel the
+//       offset of its first record, and its point count | spot count << 8
+//   light_records, R8UI, RECORD_BUFFER_WIDTH x RECORD_BUFFER_HEIGHT: the indices of the lights
+//       in LightsUniforms.lights, the points of a froxel first, then its spots
+// The lights are tested four at a time with SIMD, one z slice of the grid per job of the pool.
+class Froxelizer
+{
+public:
+    // Must match light_punctual.fs.
+    static constexpr uint32_t FROXEL_BUFFER_WIDTH_SHIFT = 6;
+    static constexpr uint32_t FROXEL_BUFFER_WIDTH       = 1u << FROXEL_BUFFER_WIDTH_SHIFT;
+    static constexpr uint32_t FROXEL_BUFFER_HEIGHT      = 128;
+    static constexpr uint32_t FROXEL_BUFFER_ENTRY_COUNT =
+            FROXEL_BUFFER_WIDTH * FROXEL_BUFFER_HEIGHT;
+
+    static constexpr uint32_t RECORD_BUFFER_WIDTH_SHIFT = 5;
+    static constexpr uint32_t RECORD_BUFFER_WIDTH       = 1u << RECORD_BUFFER_WIDTH_SHIFT;
+    static constexpr uint32_t RECORD_BUFFER_HEIGHT      = 2048;
+    static constexpr uint32_t RECORD_BUFFER_ENTRY_COUNT =
+            RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT;
+
+    static constexpr uint32_t SLICE_COUNT = 16;
+
+    // A texel of light_froxels.
+    struct FroxelEntry {
+        uint16_t recordOffset;
+        uint8_t pointCount;
+        uint8_t spotCount;
+    };
+
+    // Index in the input array is the index in LightsUniforms.lights.
+    struct Light {
+        float position[3];      // world space
+        float radius;           // falloff distance, the light has no influence beyond it
+        float direction[3];     // spot lights, world space, normalized
+        float cosOuterAngle;    // spot lights, cosine of the outer half angle
+        bool spot;
+    };
+
+    // The froxel members of the FrameUniforms (PerViewUib).
+    struct ViewParams {
+        float zParams[4];
+        uint32_t fParams[2];    // stride-y, stride-z
+        uint32_t fParamsX;      // stride-x
+        float origin[2];        // viewport left, bottom
+        float oneOverFroxelDimension;
+        float oneOverFroxelDimensionY;
+    };
+
+public:
+    Froxelizer();
+
+    void SetViewport(uint32_t left, uint32_t bottom, uint32_t width, uint32_t height) noexcept;
+
+    // clipFromView is a column-major OpenGL perspective projection, fragments have depths in
+    // [0, 1]. The first slice ends at zLightNear, the last one at the far plane of the projection
+    // or at zLightFar if it is closer, which must be the case for an infinite projection.
+    // Fragments beyond zLightFar read an empty slice that follows the grid, they get no lights.
+    void SetProjection(const float clipFromView[16], float zLightNear = 5.0f,
+        float zLightFar = 100.0f) noexcept;
+
+    // Assigns lights[0, count) to the froxels, at most CONFIG_MAX_LIGHT_COUNT. viewFromWorld is
+    // column-major. Returns false if the projection can't be froxelized, in which case there are
+    // no froxels, if the record buffer overflowed, in which case some froxels have no lights, or
+    // if more than 255 point or 255 spot lights reach a froxel, the most its counts hold, in
+    // which case the ones of highest index are left out of it.
+    bool Froxelize(ThreadPool& pool, const float viewFromWorld[16], const Light* lights,
+        size_t count);
+
+    const ViewParams& GetViewParams() const noexcept { return mViewParams; }
+
+    // FROXEL_BUFFER_ENTRY_COUNT entries, the GetFroxelCount() of the grid then an empty slice
+    const FroxelEntry* GetFroxelBuffer() const noexcept { return mFroxelBuffer.data(); }
+    // RECORD_BUFFER_ENTRY_COUNT entries, of which GetRecordCount() are used
+    const uint8_t* GetRecordBuffer() const noexcept { return mRecordBuffer.data(); }
+    size_t GetRecordCount() const noexcept { return mRecordCount; }
+
+    uint32_t GetFroxelCountX() const noexcept { return mCountX; }
+    uint32_t GetFroxelCountY() const noexcept { return mCountY; }
+    uint32_t GetFroxelCount() const noexcept { return mCountX * mCountY * SLICE_COUNT; }
+
+private:
+    static constexpr size_t LIGHT_WORDS = (CONFIG_MAX_LIGHT_COUNT + 63) / 64;
+    static constexpr size_t LIGHT_GROUPS = (CONFIG_MAX_LIGHT_COUNT + 3) / 4;
+
+    // a bit per light
+    struct LightMask {
+        uint64_t bits[LIGHT_WORDS];
+    };
+
+    // the lights of a frame in view space, four per SIMD group
+    struct LightGroup {
+        float x[4], y[4], z[4];
+        float radius[4];
+        float dirX[4], dirY[4], dirZ[4];
+        float cosAngle[4], sinAngle[4];
+        uint32_t valid;         // lane bits
+        uint32_t spot;
+    };
+
+    // Grid and planes, after the viewport or projection changed. Returns false if the projection
+    // isn't a perspective one with a finite far distance.
+    bool Update() noexcept;
+
+    void FroxelizeSlice(uint32_t slice, size_t groupCount) noexcept;
+
+    // Writes the froxel and record buffers from the light masks, returns false on overflow.
+    bool AssignRecords() noexcept;
+
+private:
+    uint32_t mViewport[4] = { 0, 0, 1, 1 };
+    float mProjection[16] = {};
+    float mZLightNear = 5.0f;
+    float mZLightFar = 100.0f;
+    bool mDirty = true;
+
+    uint32_t mCountX = 0;
+    uint32_t mCountY = 0;
+    ViewParams mViewParams = {};
+
+    // normalized view space planes through the eye: columns are (x, z), rows (y, z)
+    std::vector<float> mPlanesX;
+    std::vector<float> mPlanesY;
+    // view space distances of the slices, SLICE_COUNT + 1
+    std::vector<float> mDistancesZ;
+    // view space bounding sphere of each froxel, center and radius
+    std::vector<float> mBounds;
+
+    LightGroup mGroups[LIGHT_GROUPS];
+    uint64_t mSpotBits[LIGHT_WORDS] = {};
+    std::vector<LightMask> mLightMasks;
+
+    std::vector<FroxelEntry> mFroxelBuffer;
+    std::vector<uint8_t> mRecordBuffer;
+    size_t mRecordCount = 0;
+
+}; // Froxelizer
+
+}
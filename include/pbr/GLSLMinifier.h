@@ -0,0 +1,34 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace pbr
+{
+
+// Shrinks a validated GLSL program: drops the functions main() never reaches, the comments,
+// #line directives and whitespace, and optionally renames local variables and parameters to
+// short names. Globals (uniform blocks, samplers, inputs and outputs) keep their names. Which
+// functions are reachable, and their locals, comes from the program's AST, as collected by
+// GLSLTools::ValidateShaders().
+class GLSLMinifier
+{
+public:
+    struct Symbols {
+        // names of the functions reachable from main()
+        std::set<std::string> functions;
+        // by function name: the names of its parameters and local variables
+        std::map<std::string, std::set<std::string>> locals;
+    };
+
+    explicit GLSLMinifier(bool renameLocals) noexcept : mRenameLocals(renameLocals) {}
+
+    std::string Minify(const std::string& shader, const Symbols& symbols) const noexcept;
+
+private:
+    bool mRenameLocals;
+
+}; // GLSLMinifier
+
+}
@@ -17,12 +17,17 @@
 #pragma once
 
 #include "pbr/MaterialBuilder.h"
+#include "pbr/GLSLMinifier.h"
 
 #include <list>
+#include <set>
+#include <vector>
 
 namespace pbr
 {
 
+class ThreadPool;
+
 // Used for symbol tracking during static code analysis.
 struct Access {
     enum Type {Swizzling, DirectIndexForStruct, FunctionCall};
@@ -106,6 +111,56 @@ public:
     bool AnalyzeVertexShader(const std::string& shaderCode, ShaderModel model,
         MaterialBuilder::TargetApi targetApi) const noexcept;
 
+    // Sets in properties exactly the MaterialInputs fields that material() writes, following the
+    // material through the functions it is passed to as out or inout. shaderCode must be a
+    // fragment program generated with every property, so that all the fields are declared.
+    // If attributes isn't null, FindAttributes() is also run on the same parse.
+    // Returns false if the program isn't a valid material.
+    bool FindProperties(const std::string& shaderCode, ShaderModel model,
+        MaterialBuilder::TargetApi targetApi, MaterialBuilder::PropertyList& properties,
+        AttributeBitset* attributes = nullptr) const noexcept;
+
+    // Adds to attributes the vertex attributes read by the material code of the program:
+    // COLOR, UV0 and UV1 through their getters or MaterialVertexInputs fields, TANGENTS through
+    // the tangent frame and normal getters. shaderCode must be generated with all of these
+    // attributes required, so that the getters and fields are declared.
+    bool FindAttributes(const std::string& shaderCode, ShaderType type, ShaderModel model,
+        MaterialBuilder::TargetApi targetApi, AttributeBitset& attributes) const noexcept;
+
+    // Inserts in parameters the names of the material parameters, i.e. the fields of the
+    // MaterialParams uniform block, read by the material code of the program.
+    bool FindParameters(const std::string& shaderCode, ShaderType type, ShaderModel model,
+        MaterialBuilder::TargetApi targetApi, std::set<std::string>& parameters) const noexcept;
+
+    // Return true if the shader is syntactically and semantically valid. Unlike the Analyze*
+    // functions this doesn't require the material entry points, so it applies to every variant
+    // (e.g. depth variants which don't include the material code).
+    bool ValidateShader(const std::string& shaderCode, ShaderType type, ShaderModel model,
+        MaterialBuilder::TargetApi targetApi) const noexcept;
+
+    // Runs the preprocessor alone: output receives the program with its macros expanded, and
+    // its inactive branches, indentation, blank lines and #line directives removed, so that
+    // programs differing only by unused defines compare equal. Much cheaper than a validation.
+    bool Preprocess(const std::string& shaderCode, ShaderType type, ShaderModel model,
+        MaterialBuilder::TargetApi targetApi, std::string& output) const noexcept;
+
+    struct ShaderSource {
+        ShaderType type;
+        const std::string* shaderCode;      // must outlive the call
+        ShaderModel shaderModel;
+        MaterialBuilder::TargetApi targetApi;
+        bool analyze;                       // also check the material entry points, as Analyze*()
+        std::vector<uint32_t>* spirv;       // if not null, receives the SPIR-V of a valid shader
+        GLSLMinifier::Symbols* symbols;     // if not null, receives what GLSLMinifier needs
+    };
+
+    // Validates the shaders concurrently on pool, glslang is initialized once per process.
+    // results[i] is 1 if shaders[i] is valid;
+    // returns true if they all are. Errors are printed in the order of shaders. Shaders with a
+    // spirv output are compiled from the same parse, with the SPIR-V rules of their target api.
+    bool ValidateShaders(ThreadPool& pool, const std::vector<ShaderSource>& shaders,
+        std::vector<uint8_t>& results) const noexcept;
+
 }; // GLSLTools
 
 }
\ No newline at end of file
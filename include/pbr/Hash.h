@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <type_traits>
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace pbr
+{
+namespace hash
+{
+
+// 64-bit FNV-1a. Not cryptographic, but stable across runs and platforms, which is what cache
+// keys written to disk need. constexpr so that static data can be hashed at compile time.
+constexpr uint64_t FNV1A_OFFSET = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV1A_PRIME  = 0x100000001b3ull;
+
+constexpr uint64_t fnv1a(const char* data, size_t size, uint64_t seed = FNV1A_OFFSET) noexcept
+{
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ uint8_t(data[i])) * FNV1A_PRIME;
+    }
+    return h;
+}
+
+// Incremental hash of a sequence of values. Strings are length-prefixed so that ("ab", "c") and
+// ("a", "bc") don't collide.
+class Hasher
+{
+public:
+    Hasher& Add(const void* data, size_t size) noexcept {
+        mHash = fnv1a(static_cast<const char*>(data), size, mHash);
+        return *this;
+    }
+
+    Hasher& Add(const std::string& str) noexcept {
+        Add(uint64_t(str.size()));
+        return Add(str.data(), str.size());
+    }
+
+    Hasher& Add(const char* str) noexcept {
+        return Add(std::string(str ? str : ""));
+    }
+
+    template<typename T>
+    Hasher& Add(T value) noexcept {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                "only strings and scalar values can be hashed");
+        return Add(&value, sizeof(value));
+    }
+
+    uint64_t Get() const noexcept { return mHash; }
+
+private:
+    uint64_t mHash = FNV1A_OFFSET;
+
+}; // Hasher
+
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace pbr
+{
+namespace lz
+{
+
+// A small LZ77 codec for shader blobs: greedy matching through a hash of 4-byte sequences,
+// lengths and offsets stored as varints. Not competitive with zlib or LZ4 on ratio, but shader
+// text is repetitive enough for it to pay, and decoding is a tight copy loop.
+
+// Appends the compressed form of data to out.
+void Compress(const void* data, size_t size, std::string& out);
+
+// Decompresses data into dst, which must be exactly the uncompressed size. Returns false if the
+// input is malformed or doesn't decompress to dstSize bytes.
+bool Decompress(const void* data, size_t size, void* dst, size_t dstSize) noexcept;
+
+// LEB128 varints, as used by the stream above.
+void WriteVarint(std::string& out, size_t v);
+bool ReadVarint(const uint8_t*& p, const uint8_t* end, size_t& v) noexcept;
+
+}
+}
@@ -18,13 +18,18 @@
 
 #include "pbr/DriverEnums.h"
 #include "pbr/MaterialEnums.h"
+#include "pbr/SamplerBindingMap.h"
 
 #include <string>
+#include <vector>
 
 namespace pbr
 {
 
 struct MaterialInfo;
+struct SamplerLayer;
+class ThreadPool;
+class ShaderCache;
 
 class MaterialBuilder
 {
@@ -67,6 +72,13 @@ public:
 
     using SamplerPrecision = Precision;
 
+    // Expected values of a parameter or variable, see SetParameterRange().
+    struct ValueRange {
+        float min = 0.0f;
+        float max = 0.0f;
+        bool set = false;
+    };
+
     // The methods and types below are for internal use
     struct Parameter {
         Parameter() noexcept = default;
@@ -86,6 +98,9 @@ public:
             };
         };
         bool isSampler;
+        ValueRange range;
+        // of uniforms, chosen by the precision lowering
+        Precision precision = Precision::DEFAULT;
     };
 
     static constexpr size_t MAX_PARAMETERS_COUNT = 32;
@@ -103,23 +118,180 @@ public:
         SPIRV
     };
 
+    // Passes run on SPIR-V programs, see SpirvOptimizer. Ignored for GLSL.
+    enum class Optimization {
+        NONE,
+        PERFORMANCE,
+        SIZE
+    };
+
+    // Rewrites of GLSL programs once validated, see GLSLMinifier. Ignored for SPIR-V.
+    enum class Minification {
+        NONE,
+        STRIP,              // drop unreachable functions, comments and whitespace
+        STRIP_AND_RENAME    // also shorten the names of locals and parameters
+    };
+
     struct CodeGenParams {
         ShaderModel    shaderModel;
         TargetApi      targetApi;
         TargetLanguage targetLanguage;
+        Optimization   optimization = Optimization::NONE;
+        Minification   minification = Minification::NONE;
+    };
+
+    static constexpr uint8_t NO_ALIAS = 0xff;
+
+    // One generated program: a single stage of a single variant, for one CodeGenParams.
+    // For TargetLanguage::SPIRV the program is spirv; shader is then the GLSL it was compiled
+    // from, which is left empty when the program came from the shader cache.
+    struct ShaderOutput {
+        ShaderModel    shaderModel;
+        TargetApi      targetApi;
+        TargetLanguage targetLanguage;
+        Optimization   optimization;
+        Minification   minification;
+        ShaderType     type;
+        uint8_t        variantKey;
+        std::string    shader;
+        std::vector<uint32_t> spirv;
+        // SPIR-V instruction counts before and after optimization, 0 unless the optimizer ran on
+        // the program, in this build or in the one that put it in the shader cache
+        size_t         instructionsBefore;
+        size_t         instructionsAfter;
+        // Variant key of the identical program, of the same params and stage, that this output
+        // shares, in which case shader and spirv are left empty. NO_ALIAS for unique programs.
+        uint8_t        aliasOf = NO_ALIAS;
+    };
+    using ShaderOutputList = std::vector<ShaderOutput>;
+
+    // A precision chosen by the precision lowering that differs from the default of mobile
+    // targets: mediump for parameters, highp for variables.
+    struct PrecisionChange {
+        std::string name;   // of the parameter or variable
+        bool isVariable;
+        Precision from;
+        Precision to;
+        std::string reason;
     };
 
 public:
     MaterialBuilder();
+
+    MaterialBuilder& SetName(const std::string& name) noexcept;
+
+    // Fragment and vertex material code. lineOffset is the line of the code in its source file,
+    // for the #line directives of the generated programs.
+    MaterialBuilder& SetMaterial(const std::string& code, size_t lineOffset = 0) noexcept;
+    MaterialBuilder& SetMaterialVertex(const std::string& code, size_t lineOffset = 0) noexcept;
+
+    // Material properties set by the fragment code, e.g. BASE_COLOR.
+    MaterialBuilder& SetProperty(Property property, bool set = true) noexcept;
+
+    // When enabled, the default, Build() replaces the properties with exactly the ones written
+    // by material(), as found by GLSLTools::FindProperties(). Disable to keep the ones set with
+    // SetProperty().
+    MaterialBuilder& SetPropertyInference(bool infer) noexcept;
+
+    // Parameters are limited to MAX_PARAMETERS_COUNT, returns false with an error if the
+    // parameter is ignored.
+    bool AddParameter(UniformType type, size_t size, const std::string& name) noexcept;
+    bool AddParameter(SamplerType type, SamplerFormat format, SamplerPrecision precision,
+        const std::string& name) noexcept;
+
+    MaterialBuilder& SetVariable(Variable variable, const std::string& name) noexcept;
+
+    // When enabled, the uniform parameters are reordered to take as few bytes as possible in
+    // the MaterialParams block, see UniformInterfaceBlock::Builder::packing().
+    MaterialBuilder& SetUniformPacking(bool pack) noexcept;
+
+    // When enabled, sampler2D parameters of the same format and precision are declared as the
+    // layers of a single sampler2DArray parameter, with an int parameter _<name>Layer giving the
+    // layer of each, and the material code is rewritten to sample the array (see SamplerLayers).
+    // This saves samplers, the textures of a group must then share their size and format.
+    // Samplers the material code uses in ways that can't be rewritten, e.g. passed to a
+    // function, and shadow samplers stay on their own.
+    MaterialBuilder& SetSamplerArrays(bool arrays) noexcept;
+
+    // Range of the values of a float parameter, or written to a variable, for the precision
+    // lowering. The programs are undefined for values outside of it once lowered.
+    MaterialBuilder& SetParameterRange(const std::string& name, float min, float max) noexcept;
+    MaterialBuilder& SetVariableRange(Variable variable, float min, float max) noexcept;
+
+    // When enabled, Build() adjusts the defaults of the shader model, mediump uniforms and highp
+    // variables on mobile, from the declared ranges:
+    // - variables with a range within mediump's are lowered to mediump,
+    // - float parameters read by materialVertex(), as they usually take part in the position,
+    //   or with a range beyond mediump's are raised to highp,
+    // - the others keep their default.
+    // Parameters are never lowered, mediump already is their mobile default, and how the material
+    // code uses a value isn't analyzed beyond the parameters materialVertex() reads. Desktop
+    // targets ignore precision qualifiers. Disabled by default, as the ranges are trusted.
+    MaterialBuilder& SetPrecisionLowering(bool lower) noexcept;
+
+    // Changes made by the precision lowering of the last Build().
+    const std::vector<PrecisionChange>& GetPrecisionChanges() const noexcept {
+        return mPrecisionChanges;
+    }
+    MaterialBuilder& Require(VertexAttribute attribute) noexcept;
+
+    // When enabled, the default, Build() adds the TANGENTS, COLOR, UV0 and UV1 attributes read by
+    // materialVertex() and material(), as found by GLSLTools::FindAttributes(), to the ones set
+    // with Require(). Lit materials and shadow multipliers still require TANGENTS.
+    MaterialBuilder& SetAttributeInference(bool infer) noexcept;
+
+    MaterialBuilder& SetShading(Shading shading) noexcept;
+    MaterialBuilder& SetInterpolation(Interpolation interpolation) noexcept;
+    MaterialBuilder& SetVertexDomain(VertexDomain domain) noexcept;
+    MaterialBuilder& SetBlending(BlendingMode blending) noexcept;
+    MaterialBuilder& SetPostLightingBlending(BlendingMode blending) noexcept;
+    MaterialBuilder& SetDoubleSided(bool doubleSided) noexcept;
+    MaterialBuilder& SetShadowMultiplier(bool shadowMultiplier) noexcept;
+    MaterialBuilder& SetSpecularAntiAliasing(bool specularAntiAliasing) noexcept;
+    MaterialBuilder& SetClearCoatIorChange(bool clearCoatIorChange) noexcept;
+    MaterialBuilder& SetFlipUV(bool flipUV) noexcept;
+    MaterialBuilder& SetMultiBounceAmbientOcclusion(bool multiBounceAO) noexcept;
+    MaterialBuilder& SetSpecularAmbientOcclusion(bool specularAO) noexcept;
+
+    const std::string& GetName() const noexcept { return mMaterialName; }
+
+    // The MaterialInfo the programs are generated for, sampler bindings included.
+    void GetMaterialInfo(MaterialInfo& info) noexcept;
+
     bool RunSemanticAnalysis() noexcept;
 
+    // Generates every vertex and fragment variant needed by this material, for each of the given
+    // code generation parameters. Variants that the Variant filters map onto another key are
+    // skipped, the remaining programs are generated and validated concurrently on the pool.
+    // SPIR-V targets are compiled from the AST of that validation, then optimized as set by
+    // CodeGenParams::optimization; GLSL targets are minified as set by
+    // CodeGenParams::minification. Programs identical to one of a lower variant key are
+    // aliased to it (see ShaderOutput::aliasOf) and only processed once. Returns false if any
+    // program fails to validate; output is sorted by params, then variant.
+    bool Build(ThreadPool& pool, const std::vector<CodeGenParams>& params,
+        ShaderOutputList& output) noexcept;
+
+    // Programs found in the cache are neither generated nor validated again by Build(), programs
+    // that validate are added to it. The cache must outlive the builder; nullptr disables it.
+    void SetShaderCache(ShaderCache* cache) noexcept { mShaderCache = cache; }
+
 private:
     std::string Peek(ShaderType type, const CodeGenParams& params, 
         const PropertyList& properties) noexcept;
 
+    // Sets mProperties and the inferred attributes of mRequiredAttributes from the analysis of
+    // the material code, see SetPropertyInference() and SetAttributeInference().
+    bool AnalyzeMaterialCode() noexcept;
+
+    // Lowers the variables and raises the parameters, see SetPrecisionLowering().
+    bool LowerPrecision() noexcept;
+
     void Prepare() noexcept;
     void PrepareToBuild(MaterialInfo& info) noexcept;
 
+    // Sampler parameters grouped by SetSamplerArrays(), in the order of their arrays.
+    void GroupSamplers(std::vector<SamplerLayer>& layers) const noexcept;
+
     // Returns true if any of the parameter samplers is of type samplerExternal
     bool hasExternalSampler() const noexcept;
 
@@ -136,6 +308,8 @@ private:
     PropertyList  mProperties;
     ParameterList mParameters;
     VariableList  mVariables;
+    ValueRange    mVariableRanges[MATERIAL_VARIABLES_COUNT];
+    Precision     mVariablePrecisions[MATERIAL_VARIABLES_COUNT];
 
     BlendingMode mBlendingMode = BlendingMode::B_OPAQUE;
     BlendingMode mPostLightingBlendingMode = BlendingMode::B_TRANSPARENT;
@@ -147,6 +321,7 @@ private:
     TransparencyMode mTransparencyMode = TransparencyMode::DEFAULT;
 
     AttributeBitset mRequiredAttributes;
+    AttributeBitset mExplicitAttributes;    // set with Require(), kept by the inference
 
     float mMaskThreshold = 0.4f;
     float mSpecularAntiAliasingVariance = 0.15f;
@@ -173,6 +348,20 @@ private:
     bool mSpecularAO = false;
     bool mSpecularAOSet = false;
 
+    bool mInferProperties = true;
+    bool mInferAttributes = true;
+
+    bool mLowerPrecision = false;
+    bool mPackUniforms = false;
+    bool mSamplerArrays = false;
+    std::vector<PrecisionChange> mPrecisionChanges;
+
+    ShaderCache* mShaderCache = nullptr;
+
+    // populated once for the material samplers, reused by every GetMaterialInfo
+    SamplerBindingMap mSamplerBindings;
+    size_t mSamplerBindingsCount = SIZE_MAX;
+
 }; // MaterialBuilder
 
 }
\ No newline at end of file
@@ -16,7 +16,9 @@
 
 #pragma once
 
+#include "pbr/MaterialBuilder.h"
 #include "pbr/MaterialEnums.h"
+#include "pbr/SamplerLayers.h"
 #include "pbr/UniformInterfaceBlock.h"
 #include "pbr/SamplerInterfaceBlock.h"
 #include "pbr/SamplerBindingMap.h"
@@ -44,6 +46,12 @@ struct MaterialInfo
     UniformInterfaceBlock uib;
     SamplerInterfaceBlock sib;
     SamplerBindingMap     samplerBindings;
+    // sampler parameters of sib grouped in sampler2DArray layers
+    std::vector<SamplerLayer> samplerLayers;
+    // of the custom variables, DEFAULT is highp
+    Precision variablePrecisions[MaterialBuilder::MATERIAL_VARIABLES_COUNT] = {
+        Precision::DEFAULT, Precision::DEFAULT, Precision::DEFAULT, Precision::DEFAULT
+    };
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,241 @@
+#pragma once
+
+#include "pbr/MaterialBuilder.h"
+#include "pbr/MaterialInfo.h"
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace pbr
+{
+
+// Binary form of a built material, laid out so that a loaded file is used in place: a header
+// with the MaterialInfo fields, then flat tables (uniforms, samplers, sampler bindings, shaders,
+// blobs), a string table, an optional line dictionary and the blob data. All offsets are in
+// bytes from the start of the package, values are little endian. Shader entries are sorted by
+// key and point into a dictionary of unique blobs, so identical programs across variants are
+// stored once.
+class MaterialPackage
+{
+public:
+    static constexpr uint32_t MAGIC = 0x4d524250;  // "PBRM"
+    static constexpr uint32_t VERSION = 2;
+
+    // Largest decoded blob a reader accepts, far above any program. Bounds the allocation of
+    // decoding an untrusted package.
+    static constexpr uint32_t MAX_BLOB_SIZE = 64u << 20;
+
+    enum Flags : uint32_t {
+        COMPRESSED      = 0x1,  // some blobs are lz compressed
+        LINE_DICTIONARY = 0x2,  // some blobs are lists of lines from the line dictionary
+    };
+
+    enum class Encoding : uint32_t {
+        RAW,                    // as is, followed by a null char
+        LZ,                     // see pbr/Lz.h
+        LINES,                  // varint indices into the line dictionary
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t materialVersion;
+        uint32_t flags;
+        uint32_t size;                  // of the whole package
+
+        // MaterialInfo
+        uint32_t nameOffset;            // into the string table, as are all names
+        uint32_t requiredAttributes;
+        uint8_t  isLit;
+        uint8_t  hasDoubleSidedCapability;
+        uint8_t  hasExternalSamplers;
+        uint8_t  hasShadowMultiplier;
+        uint8_t  specularAntiAliasing;
+        uint8_t  clearCoatIorChange;
+        uint8_t  flipUV;
+        uint8_t  multiBounceAO;
+        uint8_t  multiBounceAOSet;
+        uint8_t  specularAO;
+        uint8_t  specularAOSet;
+        uint8_t  blendingMode;
+        uint8_t  postLightingBlendingMode;
+        uint8_t  shading;
+        uint8_t  padding[2];
+
+        uint32_t uibNameOffset;
+        uint32_t uibSize;
+        uint32_t uniformCount;
+        uint32_t uniformsOffset;        // Uniform[uniformCount]
+
+        uint32_t sibNameOffset;
+        uint32_t sibSize;
+        uint32_t samplerCount;
+        uint32_t samplersOffset;        // Sampler[samplerCount]
+
+        uint32_t samplerBindingCount;
+        uint32_t samplerBindingsOffset; // SamplerBinding[samplerBindingCount]
+
+        uint32_t shaderCount;
+        uint32_t shadersOffset;         // Shader[shaderCount], sorted by Shader::key
+
+        uint32_t blobCount;
+        uint32_t blobsOffset;           // Blob[blobCount]
+
+        uint32_t stringsOffset;
+        uint32_t stringsSize;
+
+        // Lines shared by all the GLSL blobs, without their newline and most used first, so
+        // that frequent lines get 1 byte indices. Line i is the bytes [offsets[i], offsets[i+1])
+        // of the line data.
+        uint32_t lineCount;
+        uint32_t lineOffsetsOffset;     // uint32_t[lineCount + 1]
+        uint32_t lineDataOffset;
+        uint32_t lineDataSize;
+    };
+
+    struct Uniform {
+        uint32_t nameOffset;
+        uint32_t size;
+        uint16_t offset;
+        uint8_t  stride;
+        uint8_t  type;
+        uint8_t  precision;
+        uint8_t  padding[3];
+    };
+
+    struct Sampler {
+        uint32_t nameOffset;
+        uint8_t  offset;
+        uint8_t  type;
+        uint8_t  format;
+        uint8_t  precision;
+        uint8_t  multisample;
+        uint8_t  padding[3];
+    };
+
+    struct SamplerBinding {
+        uint8_t blockIndex;
+        uint8_t localOffset;
+        uint8_t globalOffset;
+        uint8_t padding;
+    };
+
+    struct Shader {
+        uint32_t key;                   // see MakeKey()
+        uint32_t blobIndex;
+    };
+
+    // Raw blobs are followed by a null char, so GLSL text can be used in place.
+    struct Blob {
+        uint32_t offset;                // 8 bytes aligned
+        uint32_t size;                  // stored size
+        uint32_t rawSize;               // decoded size, the stored one for RAW blobs
+        Encoding encoding;
+    };
+
+    static uint32_t MakeKey(ShaderModel shaderModel, MaterialBuilder::TargetApi targetApi,
+        MaterialBuilder::TargetLanguage targetLanguage, ShaderType type, uint8_t variant) noexcept;
+
+public:
+    MaterialPackage() = default;
+    MaterialPackage(const MaterialPackage&) = delete;
+    MaterialPackage& operator=(const MaterialPackage&) = delete;
+    ~MaterialPackage();
+
+    // Maps the file in memory. The only work done is checking the header and table bounds.
+    bool Open(const std::string& filepath) noexcept;
+
+    // Uses a package already in memory, which must outlive this object and be 8 bytes aligned.
+    bool Open(const void* data, size_t size) noexcept;
+
+    void Close() noexcept;
+
+    const Header* GetHeader() const noexcept { return mHeader; }
+
+    const char* GetName() const noexcept;
+
+    // Rebuilds the MaterialInfo, its interface blocks and sampler bindings included.
+    bool GetMaterialInfo(MaterialInfo& info) const noexcept;
+
+    // Returns the blob of a shader in place. Fails for encoded blobs, see below.
+    bool GetShader(uint32_t key, const void*& data, size_t& size) const noexcept;
+
+    // Copies, and decodes if needed, the blob of a shader.
+    bool GetShader(uint32_t key, std::string& blob) const noexcept;
+
+private:
+    // Checks and uses a package in memory, without releasing the current one.
+    bool Use(const void* data, size_t size) noexcept;
+
+    const Blob* FindBlob(uint32_t key) const noexcept;
+    const char* GetString(uint32_t offset) const noexcept;
+    bool DecodeLines(const Blob& blob, std::string& text) const noexcept;
+
+private:
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    const Header* mHeader = nullptr;
+
+    // platform mapping, if the package was opened from a file. The view is the whole file, it
+    // can be larger than the package.
+    const void* mView = nullptr;
+    size_t mViewSize = 0;
+    void* mMapping = nullptr;
+    void* mFile = nullptr;
+
+}; // MaterialPackage
+
+// Serializes a built material into a MaterialPackage.
+class MaterialPackageWriter
+{
+public:
+    MaterialPackageWriter(const std::string& name, const MaterialInfo& info);
+
+    // Compress the blobs with lz, if it makes them smaller.
+    void SetCompression(bool compress) noexcept { mCompress = compress; }
+
+    // Store the GLSL blobs as lists of lines from a dictionary shared by all the variants. The
+    // variants repeat most of the same chunks, so this removes most of their size. Takes
+    // precedence over lz for GLSL.
+    void SetLineDictionary(bool lineDictionary) noexcept { mLineDictionary = lineDictionary; }
+
+    // Aliases (see MaterialBuilder::ShaderOutput::aliasOf) share the blob of their program,
+    // which must be added first.
+    void AddShader(const MaterialBuilder::ShaderOutput& output);
+    void AddShaders(const MaterialBuilder::ShaderOutputList& outputs);
+
+    size_t GetShaderCount() const noexcept { return mShaders.size(); }
+    size_t GetBlobCount() const noexcept { return mBlobs.size(); }
+
+    void Write(std::vector<uint8_t>& package) const;
+    bool WriteFile(const std::string& filepath) const;
+
+private:
+    // Unique lines of the GLSL blobs, most used first, and each GLSL blob as indices into them.
+    void BuildLineDictionary(std::vector<std::string>& lines,
+        std::vector<std::vector<uint32_t>>& blobLines) const;
+
+private:
+    std::string mName;
+    MaterialInfo mInfo;
+    bool mCompress = false;
+    bool mLineDictionary = false;
+
+    struct BlobData {
+        std::string data;
+        bool text;                      // GLSL, as opposed to SPIR-V
+    };
+
+    // shader key to index in mBlobs
+    std::map<uint32_t, uint32_t> mShaders;
+    std::vector<BlobData> mBlobs;
+    // blob content hash to indices in mBlobs
+    std::unordered_multimap<uint64_t, uint32_t> mBlobIndices;
+
+}; // MaterialPackageWriter
+
+}
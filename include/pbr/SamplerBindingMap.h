@@ -18,7 +18,8 @@
 
 #include "pbr/EngineEnums.h"
 
-#include <unordered_map>
+#include <algorithm>
+#include <vector>
 
 #include <stdint.h>
 #include <assert.h>
@@ -44,10 +45,20 @@ struct SamplerBindingInfo {
 
 class SamplerInterfaceBlock;
 
-// Lookup table from (BlockIndex,LocalOffset) to (GlobalOffset,GroupIndex).
-// Also stores the mapping as a flat vector of 4-tuples to make it easy to [de]serialize.
+// Lookup table from (BlockIndex,LocalOffset) to GlobalOffset, as a flat array indexed by both, so
+// that lookups are constant time and copies are plain memory copies.
+// The mapping can also be listed as a vector of SamplerBindingInfo to make it easy to [de]serialize.
 class SamplerBindingMap {
 public:
+    // Samplers per block. Material blocks hold at most MaterialBuilder::MAX_PARAMETERS_COUNT.
+    static constexpr size_t MAX_BLOCK_SAMPLERS = 32;
+
+    SamplerBindingMap() {
+        std::fill_n(mSamplerBlockOffsets, BindingPoints::COUNT, uint8_t(UNKNOWN_OFFSET));
+        std::fill_n(&mGlobalOffsets[0][0], BindingPoints::COUNT * MAX_BLOCK_SAMPLERS,
+                uint8_t(UNKNOWN_OFFSET));
+    }
+
     // Assigns a range of finalized binding points to each sampler block.
     // If a per-material SIB is provided, then material samplers are also inserted (always at the
     // end). The optional material name is used for error reporting only.
@@ -58,17 +69,22 @@ public:
     // the output argument 'globalOffset' to the globally unique binding index.
     bool getSamplerBinding(uint8_t blockIndex, uint8_t localOffset, uint8_t* globalOffset) const {
         assert(globalOffset);
-        auto iter = mBindingMap.find(getBindingKey(blockIndex, localOffset));
-        if (iter == mBindingMap.end()) {
+        if (blockIndex >= BindingPoints::COUNT || localOffset >= MAX_BLOCK_SAMPLERS ||
+                mGlobalOffsets[blockIndex][localOffset] == UNKNOWN_OFFSET) {
             return false;
         }
-        *globalOffset = iter->second.globalOffset;
+        *globalOffset = mGlobalOffsets[blockIndex][localOffset];
         return true;
     }
 
-    // Adds the given sampler to the mapping. Useful for deserialization.
+    // Adds the given sampler to the mapping, ignored with an error if out of the table. Useful for
+    // deserialization.
     void addSampler(SamplerBindingInfo info);
 
+    // Returns all the samplers of the mapping, sorted by block then offset within the block.
+    // Useful for serialization.
+    std::vector<SamplerBindingInfo> getSamplerBindings() const;
+
     // Gets the global offset of the first sampler in the given sampler block.
     uint8_t getBlockOffset(uint8_t bindingPoint) const {
         assert(UNKNOWN_OFFSET != mSamplerBlockOffsets[bindingPoint]);
@@ -77,12 +93,8 @@ public:
 
 private:
     constexpr static uint8_t UNKNOWN_OFFSET = 0xff;
-    typedef uint32_t BindingKey;
-    static BindingKey getBindingKey(uint8_t blockIndex, uint8_t localOffset) {
-        return ((uint32_t) blockIndex << 8) + localOffset;
-    }
-    std::unordered_map<BindingKey, SamplerBindingInfo> mBindingMap;
-    uint8_t mSamplerBlockOffsets[BindingPoints::COUNT] = { UNKNOWN_OFFSET };
+    uint8_t mGlobalOffsets[BindingPoints::COUNT][MAX_BLOCK_SAMPLERS];
+    uint8_t mSamplerBlockOffsets[BindingPoints::COUNT];
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace pbr
+{
+
+// A sampler parameter stored in a layer of a sampler2DArray parameter, so that materials with
+// many textures stay within MAX_SAMPLER_COUNT and bind fewer textures, see
+// MaterialBuilder::SetSamplerArrays().
+struct SamplerLayer {
+    std::string sampler;    // the sampler2D parameter, no longer declared
+    std::string array;      // the sampler2DArray parameter holding it
+    std::string layer;      // the int parameter with its layer in the array
+};
+
+// Rewrites the material code sampling grouped sampler parameters to sample their array instead.
+// Only calls to the texture functions that have a sampler2DArray overload taking the sampler as
+// first argument can be rewritten: texture, textureLod, textureGrad and their Offset versions,
+// texelFetch, texelFetchOffset and textureSize. Line numbers are kept.
+class SamplerLayers
+{
+public:
+    // GLSL names, as declared by ShaderGenerator.
+    struct Names {
+        std::string sampler;    // e.g. materialParams_albedo
+        std::string array;      // e.g. materialParams_layers0
+        std::string layer;      // e.g. materialParams._albedoLayer
+    };
+
+    // Returns true if every use of the sampler in code can be rewritten.
+    static bool CanRewrite(const std::string& code, const std::string& sampler) noexcept;
+
+    static std::string Rewrite(const std::string& code, const std::vector<Names>& layers) noexcept;
+
+}; // SamplerLayers
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <stdint.h>
+
+namespace pbr
+{
+
+// Content-addressed store of generated programs. Keys are hashes of every input that affects a
+// program (see ShaderGenerator::getProgramKey()), values are the program text, or the binary for
+// SPIR-V. With a backing directory, entries persist across runs as one file per key so that
+// incremental rebuilds skip unchanged materials. Safe to use from several threads.
+class ShaderCache
+{
+public:
+    // An empty directory keeps the cache in memory only. The directory must exist.
+    explicit ShaderCache(const std::string& directory = "");
+
+    // Returns true and sets blob if the key is present in memory or on disk.
+    bool Get(uint64_t key, std::string& blob);
+
+    void Put(uint64_t key, const std::string& blob);
+
+    void Clear();
+
+    size_t GetHitCount() const noexcept { return mHits; }
+    size_t GetMissCount() const noexcept { return mMisses; }
+
+private:
+    std::string GetFilePath(uint64_t key) const;
+
+private:
+    std::string mDirectory;
+
+    std::mutex mLock;
+    std::unordered_map<uint64_t, std::string> mEntries;
+
+    std::atomic<size_t> mHits;
+    std::atomic<size_t> mMisses;
+
+}; // ShaderCache
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace pbr
+{
+
+// The shader chunks compiled into the generator: X(id, file), id being the chunk's
+// SHADERS_<id>_DATA variable in shaders/<file>.
+#define PBR_SHADER_CHUNKS(X)                                        \
+    X(AMBIENT_OCCLUSION_FS,         "ambient_occlusion.fs")         \
+    X(BRDF_FS,                      "brdf.fs")                      \
+    X(COMMON_GETTERS_FS,            "common_getters.fs")            \
+    X(COMMON_GRAPHICS_FS,           "common_graphics.fs")           \
+    X(COMMON_LIGHTING_FS,           "common_lighting.fs")           \
+    X(COMMON_MATERIAL_FS,           "common_material.fs")           \
+    X(COMMON_MATH_FS,               "common_math.fs")               \
+    X(COMMON_SHADING_FS,            "common_shading.fs")            \
+    X(COMMON_TYPES_FS,              "common_types.fs")              \
+    X(DEPTH_MAIN_FS,                "depth_main.fs")                \
+    X(DEPTH_MAIN_VS,                "depth_main.vs")                \
+    X(GETTERS_FS,                   "getters.fs")                   \
+    X(GETTERS_VS,                   "getters.vs")                   \
+    X(INPUTS_FS,                    "inputs.fs")                    \
+    X(INPUTS_VS,                    "inputs.vs")                    \
+    X(LIGHT_DIRECTIONAL_FS,         "light_directional.fs")         \
+    X(LIGHT_INDIRECT_FS,            "light_indirect.fs")            \
+    X(LIGHT_PUNCTUAL_FS,            "light_punctual.fs")            \
+    X(MAIN_FS,                      "main.fs")                      \
+    X(MAIN_VS,                      "main.vs")                      \
+    X(MATERIAL_INPUTS_FS,           "material_inputs.fs")           \
+    X(MATERIAL_INPUTS_VS,           "material_inputs.vs")           \
+    X(SHADING_LIT_FS,               "shading_lit.fs")               \
+    X(SHADING_MODEL_CLOTH_FS,       "shading_model_cloth.fs")       \
+    X(SHADING_MODEL_STANDARD_FS,    "shading_model_standard.fs")    \
+    X(SHADING_MODEL_SUBSURFACE_FS,  "shading_model_subsurface.fs")  \
+    X(SHADING_PARAMETERS_FS,        "shading_parameters.fs")        \
+    X(SHADING_UNLIT_FS,             "shading_unlit.fs")             \
+    X(SHADOWING_FS,                 "shadowing.fs")                 \
+    X(SHADOWING_VS,                 "shadowing.vs")
+
+enum class ShaderChunkId : uint8_t
+{
+#define PBR_SHADER_CHUNK_ID(id, file) id,
+    PBR_SHADER_CHUNKS(PBR_SHADER_CHUNK_ID)
+#undef PBR_SHADER_CHUNK_ID
+    COUNT
+};
+
+// A shader chunk with its measurements, all of which are computed at compile time so that
+// generating and keying programs never has to scan the text.
+struct ShaderChunk
+{
+    const char* file;   // e.g. "brdf.fs"
+    const char* data;   // null terminated
+    size_t      size;   // in bytes, without the null char
+    size_t      lines;  // number of '\n' in data
+    uint64_t    hash;   // hash::fnv1a() of data
+};
+
+class ShaderChunks
+{
+public:
+    static const ShaderChunk& Get(ShaderChunkId id) noexcept;
+
+    // All chunks, indexed by ShaderChunkId.
+    static const ShaderChunk* GetAll() noexcept;
+
+    // Combined hash of every chunk's content.
+    static uint64_t GetHash() noexcept;
+
+}; // ShaderChunks
+
+}
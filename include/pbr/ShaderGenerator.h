@@ -19,6 +19,7 @@
 #include "pbr/MaterialBuilder.h"
 #include "pbr/MaterialEnums.h"
 #include "pbr/Variant.h"
+#include "pbr/Hash.h"
 
 namespace pbr
 {
@@ -38,17 +39,38 @@ public:
         const std::string& materialVertexCode,
         size_t vertexLineOffset) noexcept;
 
+    // sm, targetApi and targetLanguage select the flavor of the generated code, a generator
+    // instance must therefore not be shared between threads. The code before and after the
+    // material code is cached process wide, see hashPrefixInputs().
     const std::string createVertexProgram(ShaderModel sm, MaterialBuilder::TargetApi targetApi,
         MaterialBuilder::TargetLanguage targetLanguage, MaterialInfo const& material, uint8_t variantKey,
-        Interpolation interpolation, VertexDomain vertexDomain) const noexcept;
+        Interpolation interpolation, VertexDomain vertexDomain) noexcept;
 
     const std::string createFragmentProgram(ShaderModel sm, MaterialBuilder::TargetApi targetApi,
         MaterialBuilder::TargetLanguage targetLanguage, MaterialInfo const& material, uint8_t variantKey,
-        Interpolation interpolation) const noexcept;
+        Interpolation interpolation) noexcept;
+
+    // Hash of every input that affects the program createVertexProgram() or
+    // createFragmentProgram() would return for the same arguments, used as a ShaderCache key.
+    uint64_t getProgramKey(ShaderType type, ShaderModel sm, MaterialBuilder::TargetApi targetApi,
+        MaterialBuilder::TargetLanguage targetLanguage, MaterialInfo const& material,
+        uint8_t variantKey, Interpolation interpolation, VertexDomain vertexDomain) const noexcept;
 
     bool hasCustomDepthShader() const noexcept;
 
 private:
+    // everything emitted before the material code
+    void generateVertexPrefix(CodeGenerator& cg, MaterialInfo const& material, Variant variant,
+        Interpolation interpolation, VertexDomain vertexDomain) const;
+    void generateFragmentPrefix(CodeGenerator& cg, MaterialInfo const& material, Variant variant,
+        Interpolation interpolation) const;
+
+    // hash of every input of generateVertexPrefix() and generateFragmentPrefix()
+    void hashPrefixInputs(hash::Hasher& hasher, ShaderType type, ShaderModel sm,
+        MaterialBuilder::TargetApi targetApi, MaterialBuilder::TargetLanguage targetLanguage,
+        MaterialInfo const& material, uint8_t variantKey, Interpolation interpolation,
+        VertexDomain vertexDomain) const noexcept;
+
     // generate prolog for the given shader
     void generateProlog(CodeGenerator& cg, ShaderType type, bool hasExternalSamplers) const;
 
@@ -74,7 +96,8 @@ private:
     void generateShaderInputs(CodeGenerator& cg, ShaderType type, const AttributeBitset& attributes, Interpolation interpolation) const;
 
     // generate declarations for custom interpolants
-    void generateVariable(CodeGenerator& cg, ShaderType type, const std::string& name, size_t index) const;
+    void generateVariable(CodeGenerator& cg, ShaderType type, const std::string& name,
+        Precision precision, size_t index) const;
 
     // generate no-op shader for depth prepass
     void generateDepthShaderMain(CodeGenerator& cg, ShaderType type) const;
@@ -86,6 +109,9 @@ private:
     // generate samplers
     void generateSamplers(CodeGenerator& cg, uint8_t firstBinding, const SamplerInterfaceBlock& sib) const;
 
+    // material code sampling the sampler2DArray layers of the grouped samplers, see SamplerLayers
+    std::string rewriteSamplerLayers(const std::string& code, MaterialInfo const& material) const noexcept;
+
     void generateVertexDomain(CodeGenerator& cg, VertexDomain domain) const noexcept;
 
     void generateDefine(CodeGenerator& cg, const char* name, bool value) const;
@@ -108,6 +134,9 @@ private:
 
     static char const* getPrecisionQualifier(Precision precision, Precision defaultPrecision) noexcept;
 
+    // name of the instance of a uniform block in the generated code
+    static std::string getInstanceName(const UniformInterfaceBlock& uib) noexcept;
+
     static bool hasPrecision(UniformType type) noexcept;
 
     const char* getUniformPrecisionQualifier(UniformType type, Precision precision,
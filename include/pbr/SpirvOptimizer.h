@@ -0,0 +1,37 @@
+#pragma once
+
+#include "pbr/MaterialBuilder.h"
+
+#include <ostream>
+#include <vector>
+
+#include <stdint.h>
+
+namespace pbr
+{
+
+// Runs a preset of SPIRV-Tools passes over a SPIR-V program.
+//
+// PERFORMANCE inlines everything, propagates constants and removes the branches they make dead
+// (the #define driven ones, e.g. SPHERICAL_HARMONICS_BANDS or SHADOW_SAMPLING_METHOD, are
+// constant conditions once preprocessed), unrolls loops and eliminates dead code.
+// SIZE runs the SPIRV-Tools size recipe and strips debug info.
+class SpirvOptimizer
+{
+public:
+    SpirvOptimizer(MaterialBuilder::Optimization optimization, MaterialBuilder::TargetApi targetApi);
+
+    // Optimizes spirv in place. Returns false and leaves spirv untouched if a pass fails, the
+    // messages are then written to err.
+    bool Optimize(std::vector<uint32_t>& spirv, std::ostream& err) const noexcept;
+
+    // Number of instructions in a SPIR-V module, its header excluded.
+    static size_t CountInstructions(const std::vector<uint32_t>& spirv) noexcept;
+
+private:
+    MaterialBuilder::Optimization mOptimization;
+    MaterialBuilder::TargetApi mTargetApi;
+
+}; // SpirvOptimizer
+
+}
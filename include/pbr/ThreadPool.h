@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stddef.h>
+
+namespace pbr
+{
+
+// A fixed set of worker threads used to fan out independent pieces of a material build
+// (variants, validations, whole materials). The calling thread always takes part in the work,
+// so nested ParallelFor() calls from inside a job cannot starve the pool.
+class ThreadPool
+{
+public:
+    // threadCount == 0 uses one worker per hardware thread.
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that may run jobs concurrently, including the calling thread.
+    size_t GetThreadCount() const noexcept { return mWorkers.size() + 1; }
+
+    // Runs func(i) for every i in [0, count) and returns once all of them have completed.
+    // Indices are handed out dynamically, so uneven job costs balance across threads.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+private:
+    using Job = std::function<void()>;
+
+    void WorkerLoop();
+
+    // Pops and runs one queued job, returns false if the queue was empty.
+    bool RunPendingJob();
+
+private:
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::deque<Job> mJobs;
+    bool mExit = false;
+
+}; // ThreadPool
+
+}
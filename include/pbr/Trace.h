@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <ostream>
+#include <string>
+
+#include <stdint.h>
+
+namespace pbr
+{
+
+// Scoped timing of the material build phases. Spans are recorded per thread, with the material
+// and variant they belong to, and can be exported as Chrome trace events (chrome://tracing,
+// Perfetto) or aggregated per phase. While disabled, a scope costs one relaxed atomic load.
+class Trace
+{
+public:
+    static void Enable(bool enable) noexcept;
+    static bool IsEnabled() noexcept { return sEnabled.load(std::memory_order_relaxed); }
+
+    // Drops the spans recorded so far.
+    static void Clear() noexcept;
+
+    // Chrome trace-event JSON of every span recorded so far.
+    static void WriteChromeTrace(std::ostream& out);
+    static bool WriteChromeTrace(const std::string& filepath);
+
+    // Count, total, mean and max duration per phase, the most expensive first.
+    static void PrintSummary(std::ostream& out);
+
+    class Scope
+    {
+    public:
+        // name and detail must outlive the scope, detail is copied when the span is recorded.
+        explicit Scope(const char* name, const char* detail = nullptr, int variant = -1) noexcept
+            : mName(name)
+            , mDetail(detail)
+            , mVariant(variant)
+        {
+            if (IsEnabled()) {
+                mBegin = Now();
+            }
+        }
+
+        ~Scope()
+        {
+            if (mBegin >= 0) {
+                Record(mName, mDetail, mVariant, mBegin, Now());
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* mName;
+        const char* mDetail;
+        int mVariant;
+        int64_t mBegin = -1;
+
+    }; // Scope
+
+private:
+    // nanoseconds since the first call
+    static int64_t Now() noexcept;
+
+    static void Record(const char* name, const char* detail, int variant, int64_t begin,
+        int64_t end) noexcept;
+
+private:
+    static std::atomic<bool> sEnabled;
+
+}; // Trace
+
+}
+
+#define PBR_TRACE_CONCAT_(a, b) a##b
+#define PBR_TRACE_CONCAT(a, b) PBR_TRACE_CONCAT_(a, b)
+
+// PBR_TRACE_SCOPE(name[, detail[, variant]]) times the rest of the enclosing block.
+#define PBR_TRACE_SCOPE(...) ::pbr::Trace::Scope PBR_TRACE_CONCAT(pbrTraceScope, __LINE__)(__VA_ARGS__)
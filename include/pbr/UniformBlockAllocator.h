@@ -0,0 +1,96 @@
+#pragma once
+
+#include "pbr/EngineEnums.h"
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace pbr
+{
+
+// Sub-allocates per-instance uniform blocks, e.g. the MaterialParams of each material instance,
+// from a few large buffers standing for persistently mapped GPU buffers, so that instances don't
+// each need their own buffer and draws can share a buffer binding, at different offsets.
+// Offsets are aligned to the offset alignment of the device.
+//
+// The GPU may still read a block for the frames in flight, so freed blocks are only recycled
+// once the fence of the frame they were freed in has signaled. Fences are simulated on the CPU:
+// EndFrame() returns the fence of the frame and Signal() stands for the GPU reaching it. To
+// update a block the GPU may be reading, free it and write a new one. Not thread safe.
+class UniformBlockAllocator
+{
+public:
+    using Fence = uint64_t;
+
+    static constexpr uint32_t INVALID_BUFFER = UINT32_MAX;
+
+    // Blocks are bound at this binding point, see ShaderGenerator.
+    static constexpr uint8_t BINDING_POINT = BindingPoints::PER_MATERIAL_INSTANCE;
+
+    struct Allocation {
+        uint32_t buffer = INVALID_BUFFER;
+        uint32_t offset = 0;    // in bytes, aligned
+        uint32_t size = 0;      // in bytes, aligned
+        uint8_t* data = nullptr;
+
+        bool IsValid() const noexcept { return buffer != INVALID_BUFFER; }
+    };
+
+public:
+    // alignment must be a power of two, e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT. Buffers are
+    // added as needed, up to maxBuffers.
+    UniformBlockAllocator(size_t bufferSize = 64 * 1024, size_t alignment = 256,
+        size_t maxBuffers = 64);
+
+    // Returns an invalid allocation when size exceeds the buffer size or the buffers are full.
+    Allocation Allocate(size_t size) noexcept;
+
+    // The block is recycled once the fence of the current frame has signaled.
+    void Free(const Allocation& allocation) noexcept;
+
+    // Closes the current frame, returns its fence.
+    Fence EndFrame() noexcept;
+
+    // The GPU is done with the frames up to fence, their freed blocks are recycled.
+    void Signal(Fence fence) noexcept;
+
+    size_t GetBufferCount() const noexcept { return mBuffers.size(); }
+    size_t GetBufferSize() const noexcept { return mBufferSize; }
+    const uint8_t* GetBufferData(uint32_t buffer) const noexcept { return mBuffers[buffer].get(); }
+
+    // bytes handed out and not freed, and bytes waiting for their fence
+    size_t GetAllocatedSize() const noexcept { return mAllocatedSize; }
+    size_t GetPendingSize() const noexcept { return mPendingSize; }
+
+private:
+    struct Pending {
+        Fence fence;
+        Allocation allocation;
+    };
+
+    std::vector<std::unique_ptr<uint8_t[]>> mBuffers;
+    size_t mBufferSize;
+    size_t mAlignment;
+    size_t mMaxBuffers;
+
+    // bump offset in the last buffer
+    size_t mHead = 0;
+
+    // recycled blocks, by aligned size
+    std::unordered_map<uint32_t, std::vector<Allocation>> mFreeBlocks;
+    // freed blocks by increasing fence
+    std::deque<Pending> mPending;
+
+    Fence mFrameFence = 1;
+
+    size_t mAllocatedSize = 0;
+    size_t mPendingSize = 0;
+
+}; // UniformBlockAllocator
+
+}
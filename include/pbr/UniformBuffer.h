@@ -0,0 +1,154 @@
+#pragma once
+
+#include "pbr/UniformInterfaceBlock.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace pbr
+{
+
+// CPU copy of the uniforms of a UniformInterfaceBlock, at their std140 offsets. Uniforms are set
+// through handles resolved once from their names, and the bytes changed since the last Flush()
+// are tracked as a single range, so that only those get uploaded. Setting a uniform to the value
+// it already holds doesn't dirty it. The block must outlive the buffer, it is not copied.
+class UniformBuffer
+{
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+    // Bytes to upload, starting at GetData() + offset. Empty when size is 0.
+    struct Range {
+        size_t offset;
+        size_t size;
+    };
+
+public:
+    // The whole buffer starts dirty, zero initialized. Keeps a reference to uib.
+    explicit UniformBuffer(const UniformInterfaceBlock& uib);
+
+    // INVALID_HANDLE for unknown names, the setters then ignore it.
+    Handle GetHandle(const std::string& name) const noexcept;
+
+    // The type of the setter must be the type of the uniform, index is the element of arrays.
+    void SetFloat(Handle handle, float value, size_t index = 0) noexcept {
+        Write(handle, UniformType::FLOAT, index, &value, sizeof(value));
+    }
+    void SetFloat2(Handle handle, const float value[2], size_t index = 0) noexcept {
+        Write(handle, UniformType::FLOAT2, index, value, sizeof(float) * 2);
+    }
+    void SetFloat3(Handle handle, const float value[3], size_t index = 0) noexcept {
+        Write(handle, UniformType::FLOAT3, index, value, sizeof(float) * 3);
+    }
+    void SetFloat4(Handle handle, const float value[4], size_t index = 0) noexcept {
+        Write(handle, UniformType::FLOAT4, index, value, sizeof(float) * 4);
+    }
+    void SetInt(Handle handle, int32_t value, size_t index = 0) noexcept {
+        Write(handle, UniformType::INT, index, &value, sizeof(value));
+    }
+    void SetInt2(Handle handle, const int32_t value[2], size_t index = 0) noexcept {
+        Write(handle, UniformType::INT2, index, value, sizeof(int32_t) * 2);
+    }
+    void SetInt3(Handle handle, const int32_t value[3], size_t index = 0) noexcept {
+        Write(handle, UniformType::INT3, index, value, sizeof(int32_t) * 3);
+    }
+    void SetInt4(Handle handle, const int32_t value[4], size_t index = 0) noexcept {
+        Write(handle, UniformType::INT4, index, value, sizeof(int32_t) * 4);
+    }
+    void SetUint(Handle handle, uint32_t value, size_t index = 0) noexcept {
+        Write(handle, UniformType::UINT, index, &value, sizeof(value));
+    }
+    void SetUint2(Handle handle, const uint32_t value[2], size_t index = 0) noexcept {
+        Write(handle, UniformType::UINT2, index, value, sizeof(uint32_t) * 2);
+    }
+    void SetUint3(Handle handle, const uint32_t value[3], size_t index = 0) noexcept {
+        Write(handle, UniformType::UINT3, index, value, sizeof(uint32_t) * 3);
+    }
+    void SetUint4(Handle handle, const uint32_t value[4], size_t index = 0) noexcept {
+        Write(handle, UniformType::UINT4, index, value, sizeof(uint32_t) * 4);
+    }
+    void SetBool(Handle handle, bool value, size_t index = 0) noexcept {
+        WriteBools(handle, UniformType::BOOL, index, &value, 1);
+    }
+    void SetBool2(Handle handle, const bool value[2], size_t index = 0) noexcept {
+        WriteBools(handle, UniformType::BOOL2, index, value, 2);
+    }
+    void SetBool3(Handle handle, const bool value[3], size_t index = 0) noexcept {
+        WriteBools(handle, UniformType::BOOL3, index, value, 3);
+    }
+    void SetBool4(Handle handle, const bool value[4], size_t index = 0) noexcept {
+        WriteBools(handle, UniformType::BOOL4, index, value, 4);
+    }
+    // column major
+    void SetMat3(Handle handle, const float value[9], size_t index = 0) noexcept;
+    void SetMat4(Handle handle, const float value[16], size_t index = 0) noexcept {
+        Write(handle, UniformType::MAT4, index, value, sizeof(float) * 16);
+    }
+
+    bool IsDirty() const noexcept { return mDirtyBegin < mDirtyEnd; }
+
+    // Returns the range changed since the last call and clears it.
+    Range Flush() noexcept;
+
+    // Marks the whole buffer dirty, e.g. when its GPU copy is lost.
+    void Invalidate() noexcept;
+
+    const uint8_t* GetData() const noexcept {
+        return reinterpret_cast<const uint8_t*>(mStorage.data());
+    }
+    size_t GetSize() const noexcept { return mSize; }
+
+private:
+    // std140 booleans take 4 bytes each
+    void WriteBools(Handle handle, UniformType type, size_t index, const bool* value,
+                    size_t count) noexcept {
+        uint32_t words[4];
+        for (size_t i = 0; i < count; i++) {
+            words[i] = value[i] ? 1 : 0;
+        }
+        Write(handle, type, index, words, sizeof(uint32_t) * count);
+    }
+
+    void Write(Handle handle, UniformType type, size_t index, const void* data,
+               size_t size) noexcept {
+        auto const& uniforms = mBlock.getUniformInfoList();
+        if (handle >= uniforms.size()) {
+            return;
+        }
+        auto const& info = uniforms[handle];
+        assert(info.type == type && index < info.size);
+        if (info.type != type || index >= info.size) {
+            return;
+        }
+        const size_t offset = info.getBufferOffset(index);
+        uint8_t* dst = reinterpret_cast<uint8_t*>(mStorage.data()) + offset;
+        if (memcmp(dst, data, size) == 0) {
+            return;
+        }
+        memcpy(dst, data, size);
+        mDirtyBegin = std::min(mDirtyBegin, offset);
+        mDirtyEnd = std::max(mDirtyEnd, offset + size);
+    }
+
+private:
+    // float4 slots, so that the data is 16 bytes aligned like the GPU copy
+    struct alignas(16) Slot {
+        uint8_t bytes[16];
+    };
+
+    const UniformInterfaceBlock& mBlock;
+    std::vector<Slot> mStorage;
+    size_t mSize = 0;
+
+    size_t mDirtyBegin = 0;
+    size_t mDirtyEnd = 0;
+
+}; // UniformBuffer
+
+}
@@ -18,6 +18,7 @@
 
 #include <pbr/DriverEnums.h>
 
+#include <iosfwd>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -43,6 +44,13 @@ public:
             return *this;
         }
 
+        // When enabled, the uniforms are reordered to minimize the std140 padding of the block,
+        // e.g. scalars fill the tail of float3s. They are then declared in that order.
+        Builder& packing(bool pack) {
+            mPacking = pack;
+            return *this;
+        }
+
         UniformInterfaceBlock build() {
             return UniformInterfaceBlock(*this);
         }
@@ -51,6 +59,7 @@ public:
         friend class UniformInterfaceBlock;
 
         std::string mName;
+        bool mPacking = false;
 
         struct Entry
         {
@@ -99,12 +108,30 @@ public:
     // size in bytes needed to store the uniforms described by this interface block in a UniformBuffer
     size_t getSize() const noexcept { return mSize; }
 
+    // size in bytes the uniforms would take in declaration order, getSize() unless packed
+    size_t getUnpackedSize() const noexcept { return mUnpackedSize; }
+
     // list of information records for each uniform
     std::vector<UniformInfo> const& getUniformInfoList() const noexcept { return mUniformsInfoList; }
 
+    // index in getUniformInfoList() of the named uniform, or -1 if there is none
+    int32_t getUniformIndex(const std::string& name) const noexcept {
+        auto it = mInfoMap.find(name);
+        return it == mInfoMap.end() ? -1 : int32_t(it->second);
+    }
+
+    // writes the offset and size of each uniform, and the bytes saved by packing
+    void printLayout(std::ostream& out) const;
+
 private:
     explicit UniformInterfaceBlock(const Builder& builder) noexcept;
 
+    using EntryList = std::vector<const Builder::Entry*>;
+
+    // std140 offsets of the entries in the given order, returns the size in bytes
+    static uint32_t layout(const EntryList& entries, std::vector<UniformInfo>* infos) noexcept;
+    static void pack(EntryList& entries) noexcept;
+
     static uint8_t baseAlignmentForType(UniformType type) noexcept;
     static uint8_t strideForType(UniformType type) noexcept;
 
@@ -116,6 +143,7 @@ private:
     std::unordered_map<std::string, uint32_t> mInfoMap;
 
     uint32_t mSize = 0; // size in bytes
+    uint32_t mUnpackedSize = 0;
 
 }; // UniformInterfaceBlock
 
@@ -1,4 +1,4 @@
-static const char* SHADERS_AMBIENT_OCCLUSION_FS_DATA = R"(
+static constexpr const char* SHADERS_AMBIENT_OCCLUSION_FS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Ambient occlusion helpers
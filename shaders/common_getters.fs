@@ -1,4 +1,4 @@
-static const char* SHADERS_COMMON_GETTERS_FS_DATA = R"(
+static constexpr const char* SHADERS_COMMON_GETTERS_FS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Uniforms access
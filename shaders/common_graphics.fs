@@ -1,4 +1,4 @@
-static const char* SHADERS_COMMON_GRAPHICS_FS_DATA = R"(
+static constexpr const char* SHADERS_COMMON_GRAPHICS_FS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Common color operations
@@ -1,4 +1,4 @@
-static const char* SHADERS_COMMON_LIGHTING_FS_DATA = R"(
+static constexpr const char* SHADERS_COMMON_LIGHTING_FS_DATA = R"(
 
 struct Light {
     vec4 colorIntensity;  // rgb, pre-exposed intensity
@@ -1,4 +1,4 @@
-static const char* SHADERS_COMMON_MATERIAL_FS_DATA = R"(
+static constexpr const char* SHADERS_COMMON_MATERIAL_FS_DATA = R"(
 
 #if defined(TARGET_MOBILE)
     // min roughness such that (MIN_PERCEPTUAL_ROUGHNESS^4) > 0 in fp16 (i.e. 2^(-14/4), rounded up)
@@ -1,4 +1,4 @@
-static const char* SHADERS_COMMON_MATH_FS_DATA = R"(
+static constexpr const char* SHADERS_COMMON_MATH_FS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Common math
@@ -1,4 +1,4 @@
-static const char* SHADERS_COMMON_SHADING_FS_DATA = R"(
+static constexpr const char* SHADERS_COMMON_SHADING_FS_DATA = R"(
 
 // These variables should be in a struct but some GPU drivers ignore the
 // precision qualifier on individual struct members
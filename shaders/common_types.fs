@@ -1,4 +1,4 @@
-static const char* SHADERS_COMMON_TYPES_FS_DATA = R"(
+static constexpr const char* SHADERS_COMMON_TYPES_FS_DATA = R"(
 
 #if !defined(TARGET_MOBILE) || defined(TARGET_LANGUAGE_SPIRV)
 #define LAYOUT_LOCATION(x) layout(location = x)
@@ -1,4 +1,4 @@
-static const char* SHADERS_DEPTH_MAIN_VS_DATA = R"(
+static constexpr const char* SHADERS_DEPTH_MAIN_VS_DATA = R"(
 
 // The sole purpose of this no-op function is to improve parity between the depth vertex shader
 // and color vertex shader, thus working around a variance issue seen with NVIDIA drivers.
@@ -1,4 +1,4 @@
-static const char* SHADERS_GETTERS_FS_DATA = R"(
+static constexpr const char* SHADERS_GETTERS_FS_DATA = R"(
 
 #if defined(HAS_ATTRIBUTE_COLOR)
 /** @public-api */
@@ -1,4 +1,4 @@
-static const char* SHADERS_GETTERS_VS_DATA = R"(
+static constexpr const char* SHADERS_GETTERS_VS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Uniforms access
@@ -1,4 +1,4 @@
-static const char* SHADERS_INPUTS_FS_DATA = R"(
+static constexpr const char* SHADERS_INPUTS_FS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Attributes and uniforms
@@ -1,4 +1,4 @@
-static const char* SHADERS_INPUTS_VS_DATA = R"(
+static constexpr const char* SHADERS_INPUTS_VS_DATA = R"(
 
 layout(location = LOCATION_POSITION) in vec4 mesh_position;
 
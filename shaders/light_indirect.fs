@@ -1,4 +1,4 @@
-static const char* SHADERS_LIGHT_INDIRECT_FS_DATA = R"(
+static constexpr const char* SHADERS_LIGHT_INDIRECT_FS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Image based lighting configuration
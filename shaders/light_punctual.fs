@@ -1,10 +1,10 @@
-static const char* SHADERS_LIGHT_PUNCTUAL_FS_DATA = R"(
+static constexpr const char* SHADERS_LIGHT_PUNCTUAL_FS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Punctual lights evaluation
 //------------------------------------------------------------------------------
 
-// Make sure this matches the same constants in Froxel.cpp
+// Make sure this matches the same constants in Froxelizer.h
 #define FROXEL_BUFFER_WIDTH_SHIFT   6u
 #define FROXEL_BUFFER_WIDTH         (1u << FROXEL_BUFFER_WIDTH_SHIFT)
 #define FROXEL_BUFFER_WIDTH_MASK    (FROXEL_BUFFER_WIDTH - 1u)
@@ -13,6 +13,8 @@ static const char* SHADERS_LIGHT_PUNCTUAL_FS_DATA = R"(
 #define RECORD_BUFFER_WIDTH         (1u << RECORD_BUFFER_WIDTH_SHIFT)
 #define RECORD_BUFFER_WIDTH_MASK    (RECORD_BUFFER_WIDTH - 1u)
 
+#define FROXEL_SLICE_COUNT          16u
+
 struct FroxelParams {
     uint recordOffset; // offset at which the list of lights for this froxel starts
     uint pointCount;   // number of point lights in this froxel
@@ -29,9 +31,11 @@ uvec3 getFroxelCoords(const vec3 fragCoords) {
     froxelCoord.xy = uvec2((fragCoords.xy - frameUniforms.origin.xy) *
             vec2(frameUniforms.oneOverFroxelDimension, frameUniforms.oneOverFroxelDimensionY));
 
-    froxelCoord.z = uint(max(0.0,
+    // fragments past the last slice read the empty slice that follows it
+    froxelCoord.z = uint(clamp(
             log2(frameUniforms.zParams.x * fragCoords.z + frameUniforms.zParams.y) *
-                    frameUniforms.zParams.z + frameUniforms.zParams.w));
+                    frameUniforms.zParams.z + frameUniforms.zParams.w,
+            0.0, float(FROXEL_SLICE_COUNT)));
 
     return froxelCoord;
 }
@@ -1,4 +1,4 @@
-static const char* SHADERS_MAIN_FS_DATA = R"(
+static constexpr const char* SHADERS_MAIN_FS_DATA = R"(
 
 #if defined(MATERIAL_HAS_POST_LIGHTING_COLOR)
 void blendPostLightingColor(const MaterialInputs material, inout vec4 color) {
@@ -1,4 +1,4 @@
-static const char* SHADERS_MAIN_VS_DATA = R"(
+static constexpr const char* SHADERS_MAIN_VS_DATA = R"(
 
 void main() {
     // Initialize the inputs to sensible default values, see material_inputs.vs
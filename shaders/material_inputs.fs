@@ -1,4 +1,4 @@
-static const char* SHADERS_MATERIAL_INPUTS_FS_DATA = R"(
+static constexpr const char* SHADERS_MATERIAL_INPUTS_FS_DATA = R"(
 
 // Decide if we can skip lighting when dot(n, l) <= 0.0
 #if defined(SHADING_MODEL_CLOTH)
@@ -1,4 +1,4 @@
-static const char* SHADERS_MATERIAL_INPUTS_VS_DATA = R"(
+static constexpr const char* SHADERS_MATERIAL_INPUTS_VS_DATA = R"(
 
 struct MaterialVertexInputs {
 #ifdef HAS_ATTRIBUTE_COLOR
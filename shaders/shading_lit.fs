@@ -1,4 +1,4 @@
-static const char* SHADERS_SHADING_LIT_FS_DATA = R"(
+static constexpr const char* SHADERS_SHADING_LIT_FS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Lighting
@@ -1,4 +1,4 @@
-static const char* SHADERS_SHADING_MODEL_CLOTH_FS_DATA = R"(
+static constexpr const char* SHADERS_SHADING_MODEL_CLOTH_FS_DATA = R"(
 
 /**
  * Evaluates lit materials with the cloth shading model. Similar to the standard
@@ -1,4 +1,4 @@
-static const char* SHADERS_SHADING_MODEL_STANDARD_FS_DATA = R"(
+static constexpr const char* SHADERS_SHADING_MODEL_STANDARD_FS_DATA = R"(
 
 #if defined(MATERIAL_HAS_CLEAR_COAT)
 float clearCoatLobe(const PixelParams pixel, const vec3 h, float NoH, float LoH, out float Fcc) {
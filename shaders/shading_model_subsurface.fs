@@ -1,4 +1,4 @@
-static const char* SHADERS_SHADING_MODEL_SUBSURFACE_FS_DATA = R"(
+static constexpr const char* SHADERS_SHADING_MODEL_SUBSURFACE_FS_DATA = R"(
 
 /**
  * Evalutes lit materials with the subsurface shading model. This model is a
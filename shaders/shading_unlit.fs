@@ -1,4 +1,4 @@
-static const char* SHADERS_SHADING_UNLIT_FS_DATA = R"(
+static constexpr const char* SHADERS_SHADING_UNLIT_FS_DATA = R"(
 
 /**
  * Evaluates unlit materials. In this lighting model, only the base color and
@@ -1,4 +1,4 @@
-static const char* SHADERS_SHADOWING_FS_DATA = R"(
+static constexpr const char* SHADERS_SHADOWING_FS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Shadowing configuration
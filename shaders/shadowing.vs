@@ -1,4 +1,4 @@
-static const char* SHADERS_SHADOWING_VS_DATA = R"(
+static constexpr const char* SHADERS_SHADOWING_VS_DATA = R"(
 
 //------------------------------------------------------------------------------
 // Shadowing
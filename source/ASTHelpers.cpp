@@ -22,6 +22,8 @@
 
 #include <iostream>
 
+#include <string.h>
+
 using namespace glslang;
 
 namespace ASTUtils {
@@ -99,6 +101,71 @@ private:
     bool mFunctionFound = false;
 };
 
+// Collects every function definition of the AST, by glslang mangled signature.
+class FunctionDefinitionCollector : public TIntermTraverser {
+public:
+    explicit FunctionDefinitionCollector(std::map<std::string, TIntermAggregate*>& functions)
+            : mFunctions(functions) {
+    }
+
+    bool visitAggregate(TVisit, TIntermAggregate* node) override {
+        if (node->getOp() == EOpFunction) {
+            mFunctions[node->getName().c_str()] = node;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::map<std::string, TIntermAggregate*>& mFunctions;
+};
+
+// Collects the signatures of the functions called in a node, without following the calls.
+class FunctionCallCollector : public TIntermTraverser {
+public:
+    explicit FunctionCallCollector(std::vector<std::string>& calls) : mCalls(calls) {
+    }
+
+    bool visitAggregate(TVisit, TIntermAggregate* node) override {
+        if (node->getOp() == EOpFunctionCall) {
+            mCalls.push_back(node->getName().c_str());
+        }
+        return true;
+    }
+
+private:
+    std::vector<std::string>& mCalls;
+};
+
+// Collects the names of the parameters and local variables found in a function definition.
+class LocalVariableCollector : public TIntermTraverser {
+public:
+    explicit LocalVariableCollector(std::set<std::string>& names) : mNames(names) {
+    }
+
+    void visitSymbol(TIntermSymbol* node) override {
+        switch (node->getQualifier().storage) {
+            case EvqTemporary:
+            case EvqIn:
+            case EvqOut:
+            case EvqInOut:
+            case EvqConstReadOnly: {
+                // skip the nameless or internal symbols glslang may create
+                const char* name = node->getName().c_str();
+                if (name[0] != '\0' && name[0] != '@' && strncmp(name, "anon@", 5) != 0) {
+                    mNames.insert(name);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+private:
+    std::set<std::string>& mNames;
+};
+
 // For debugging and printing out an AST portion. Mostly incomplete but complete enough for our need
 // TODO: Add more switch cases as needed.
 const char* op2Str(TOperator op) {
@@ -154,6 +221,28 @@ static const TIntermTyped* findLValueBase(const TIntermTyped* node, pbr::Symbol&
 }
 
 
+// Collects the names of the fields accessed on values of a struct type.
+class StructFieldCollector : public TIntermTraverser {
+public:
+    StructFieldCollector(const std::string& structName, std::set<std::string>& fields)
+            : mStructName(structName), mFields(fields) {
+    }
+
+    bool visitBinary(TVisit, TIntermBinary* node) override {
+        if (node->getOp() == EOpIndexDirectStruct) {
+            const TType& type = node->getLeft()->getType();
+            if (type.isStruct() && mStructName == type.getTypeName().c_str()) {
+                mFields.insert(getIndexDirectStructString(*node));
+            }
+        }
+        return true;
+    }
+
+private:
+    const std::string& mStructName;
+    std::set<std::string>& mFields;
+};
+
 class SymbolsTracer : public TIntermTraverser {
 public:
     explicit SymbolsTracer(std::deque<pbr::Symbol>& events) : mEvents(events) {
@@ -319,6 +408,58 @@ bool isFunctionCalled(const std::string& functionName, TIntermNode& functionNode
     return traverser.functionWasCalled();
 }
 
+void getFunctionDefinitions(TIntermNode& rootNode,
+        std::map<std::string, glslang::TIntermAggregate*>& functions) noexcept {
+    FunctionDefinitionCollector collector(functions);
+    rootNode.traverse(&collector);
+}
+
+void getReachableFunctions(const std::string& entryPoint, TIntermNode& rootNode,
+        std::set<std::string>& functions, const std::set<std::string>& skipped) noexcept {
+    std::map<std::string, TIntermAggregate*> definitions;
+    getFunctionDefinitions(rootNode, definitions);
+
+    std::set<std::string> visited;
+    std::vector<std::string> pending;
+    for (auto const& definition : definitions) {
+        if (getFunctionName(definition.first) == entryPoint) {
+            pending.push_back(definition.first);
+        }
+    }
+    while (!pending.empty()) {
+        std::string signature = pending.back();
+        pending.pop_back();
+        if (!visited.insert(signature).second) {
+            continue;
+        }
+        std::string name = getFunctionName(signature);
+        if (skipped.count(name)) {
+            continue;
+        }
+        functions.insert(name);
+
+        auto itr = definitions.find(signature);
+        if (itr != definitions.end()) {
+            FunctionCallCollector calls(pending);
+            itr->second->traverse(&calls);
+        }
+    }
+}
+
+void getLocalVariables(TIntermAggregate* func, std::set<std::string>& names) noexcept {
+    if (func == nullptr) {
+        return;
+    }
+    LocalVariableCollector collector(names);
+    func->traverse(&collector);
+}
+
+void getStructFieldAccesses(TIntermNode& node, const std::string& structName,
+        std::set<std::string>& fields) noexcept {
+    StructFieldCollector collector(structName, fields);
+    node.traverse(&collector);
+}
+
 void traceSymbols(TIntermNode& functionNode, std::deque<pbr::Symbol>& events) {
     SymbolsTracer variableTracer(events);
     functionNode.traverse(&variableTracer);
@@ -1,87 +1,101 @@
 #include "pbr/CodeGenerator.h"
 
+#include <algorithm>
+
 #include <stdarg.h>
+#include <stdio.h>
 
-namespace pbr
+namespace
 {
 
-//////////////////////////////////////////////////////////////////////////
-// class CodeBlock
-//////////////////////////////////////////////////////////////////////////
+const size_t ARENA_BLOCK_SIZE = 16 * 1024;
 
-bool CodeBlock::ExistLine(const std::string& line) const
-{
-	for (auto& c : m_children) {
-        if (c->ExistLine(line)) {
-            return true;
-        }
-	}
-	return false;
 }
 
-void CodeBlock::ToText(std::string& text) const
+namespace pbr
 {
-	if (m_header.empty())
-	{
-        for (auto& c : m_children) {
-            c->ToText(text);
-        }
-	}
-	else
-	{
-        for (auto& c : m_children)
-		{
-			text += m_header;
-			c->ToText(text);
-		}
-	}
-}
-
-//////////////////////////////////////////////////////////////////////////
-// class CodeGenerator
-//////////////////////////////////////////////////////////////////////////
 
 CodeGenerator::CodeGenerator()
 {
-    m_block = std::make_shared<CodeBlock>();
+	m_pieces.reserve(256);
 }
 
 void CodeGenerator::Line(const std::string& s/* = ""*/)
 {
-	m_block->Add(std::make_shared<CodeLine>(m_header + s));
+	const size_t size = m_header.size() + s.size();
+	char* dst = Allocate(size);
+	memcpy(dst, m_header.data(), m_header.size());
+	memcpy(dst + m_header.size(), s.data(), s.size());
+	AddPiece(dst, size, true);
+	m_line_count += CountLines(dst, size) + 1;
 }
 
 void CodeGenerator::LineFmt(const std::string fmt, ...)
 {
-	int size = ((int)fmt.size()) * 2 + 50;   // Use a rubric appropriate for your code
-	std::string str;
+	// measure first, then format straight into the arena
 	va_list ap;
-	while (1) {     // Maximum two passes on a POSIX system...
-		str.resize(size);
-		va_start(ap, fmt);
-		int n = vsnprintf((char *)str.data(), size, fmt.c_str(), ap);
-		va_end(ap);
-		if (n > -1 && n < size) {  // Everything worked
-			str.resize(n);
-			break;
-		}
-		if (n > -1)  // Needed size returned
-			size = n + 1;   // For null char
-		else
-			size *= 2;      // Guess at a larger size (OS specific)
+	va_start(ap, fmt);
+	int n = vsnprintf(nullptr, 0, fmt.c_str(), ap);
+	va_end(ap);
+	if (n < 0) {
+		return;
 	}
-    Line(str);
+
+	const size_t size = m_header.size() + n;
+	char* dst = Allocate(size + 1);    // vsnprintf always writes the null char
+	memcpy(dst, m_header.data(), m_header.size());
+	va_start(ap, fmt);
+	vsnprintf(dst + m_header.size(), n + 1, fmt.c_str(), ap);
+	va_end(ap);
+	AddPiece(dst, size, true);
+	m_line_count += CountLines(dst, size) + 1;
+}
+
+void CodeGenerator::Chunk(const char* str, size_t size, size_t lines)
+{
+	if (!m_header.empty()) {
+		char* dst = Allocate(m_header.size());
+		memcpy(dst, m_header.data(), m_header.size());
+		AddPiece(dst, m_header.size(), false);
+	}
+	AddPiece(str, size, true);
+	m_line_count += lines + 1;
 }
 
 void CodeGenerator::Block(CodeGenerator& gen)
 {
-	gen.m_block->SetHeader(m_header);
-	m_block->Add(gen.m_block);
+	// keep gen's lines alive for as long as we reference them
+	m_arena.insert(m_arena.end(), gen.m_arena.begin(), gen.m_arena.end());
+
+	const char* header = nullptr;
+	if (!m_header.empty()) {
+		char* dst = Allocate(m_header.size());
+		memcpy(dst, m_header.data(), m_header.size());
+		header = dst;
+	}
+
+	// the indentation goes in front of each line of gen once, a line can start with gen's own
+	m_pieces.reserve(m_pieces.size() + gen.m_pieces.size() * 2);
+	bool lineStart = true;
+	for (auto& p : gen.m_pieces)
+	{
+		if (header && lineStart) {
+			AddPiece(header, m_header.size(), false);
+		}
+		m_pieces.push_back(p);
+		lineStart = p.newline;
+	}
+	m_line_count += gen.m_line_count;
 }
 
 bool CodeGenerator::ExistLine(const std::string& line) const
 {
-	return m_block->ExistLine(line);
+	for (auto& p : m_pieces) {
+		if (p.newline && p.size == line.size() && memcmp(p.str, line.data(), p.size) == 0) {
+			return true;
+		}
+	}
+	return false;
 }
 
 void CodeGenerator::Tab()
@@ -96,9 +110,50 @@ void CodeGenerator::DeTab()
 
 std::string CodeGenerator::ToText() const
 {
+	size_t size = 0;
+	for (auto& p : m_pieces) {
+		size += p.size + (p.newline ? 1 : 0);
+	}
+
 	std::string str;
-	m_block->ToText(str);
+	str.resize(size);
+	char* dst = &str[0];
+	for (auto& p : m_pieces)
+	{
+		memcpy(dst, p.str, p.size);
+		dst += p.size;
+		if (p.newline) {
+			*dst++ = '\n';
+		}
+	}
 	return str;
 }
 
-}
\ No newline at end of file
+size_t CodeGenerator::CountLines(const char* str, size_t size)
+{
+	size_t lines = 0;
+	const char* end = str + size;
+	while ((str = static_cast<const char*>(memchr(str, '\n', end - str))) != nullptr) {
+		++lines;
+		++str;
+	}
+	return lines;
+}
+
+char* CodeGenerator::Allocate(size_t size)
+{
+	if (!m_arena_block || m_arena_used + size > m_arena_size)
+	{
+		// lines bigger than a block get a block of their own
+		const size_t block_size = std::max(size, ARENA_BLOCK_SIZE);
+		m_arena.emplace_back(new char[block_size], std::default_delete<char[]>());
+		m_arena_block = m_arena.back().get();
+		m_arena_used = 0;
+		m_arena_size = block_size;
+	}
+	char* ptr = m_arena_block + m_arena_used;
+	m_arena_used += size;
+	return ptr;
+}
+
+}
@@ -0,0 +1,100 @@
+#include "pbr/DescriptorLayout.h"
+#include "pbr/EngineEnums.h"
+#include "pbr/Hash.h"
+#include "pbr/MaterialInfo.h"
+#include "pbr/SibGenerator.h"
+
+#include <algorithm>
+
+namespace pbr
+{
+
+uint64_t DescriptorSetLayout::GetHash() const noexcept
+{
+    hash::Hasher hasher;
+    hasher.Add(set).Add(uint64_t(bindings.size()));
+    for (auto const& b : bindings) {
+        hasher.Add(b.binding).Add(b.type).Add(b.stages);
+    }
+    return hasher.Get();
+}
+
+void DescriptorSetLayout::Print(std::ostream& out) const
+{
+    out << "set " << set << ":";
+    for (size_t i = 0; i < bindings.size(); i++) {
+        auto const& b = bindings[i];
+        out << (i ? ", " : " ") << b.binding
+            << (b.type == DescriptorType::UNIFORM_BUFFER ? " ubo " : " sampler ")
+            << ((b.stages & STAGE_VERTEX) ? "v" : "")
+            << ((b.stages & STAGE_FRAGMENT) ? "f" : "");
+    }
+}
+
+DescriptorLayout::DescriptorLayout(const MaterialInfo& material) noexcept
+{
+    const uint8_t ALL_STAGES = STAGE_VERTEX | STAGE_FRAGMENT;
+
+    DescriptorSetLayout& uniforms = mSets[UNIFORM_SET];
+    uniforms.set = UNIFORM_SET;
+    auto addUniform = [&](uint32_t binding, uint8_t stages) {
+        uniforms.bindings.push_back({ binding, DescriptorType::UNIFORM_BUFFER, stages });
+    };
+    addUniform(BindingPoints::PER_VIEW, ALL_STAGES);
+    addUniform(BindingPoints::PER_RENDERABLE, STAGE_VERTEX);
+    addUniform(BindingPoints::PER_RENDERABLE_BONES, STAGE_VERTEX);
+    addUniform(BindingPoints::LIGHTS, STAGE_FRAGMENT);
+    // empty blocks are not declared
+    if (!material.uib.getUniformInfoList().empty()) {
+        addUniform(BindingPoints::PER_MATERIAL_INSTANCE, ALL_STAGES);
+    }
+
+    DescriptorSetLayout& samplers = mSets[SAMPLER_SET];
+    samplers.set = SAMPLER_SET;
+    auto addSamplers = [&](uint8_t blockIndex, const SamplerInterfaceBlock& sib, uint8_t stages) {
+        const uint8_t firstBinding = material.samplerBindings.getBlockOffset(blockIndex);
+        for (auto const& info : sib.getSamplerInfoList()) {
+            samplers.bindings.push_back({ uint32_t(firstBinding + info.offset),
+                    DescriptorType::COMBINED_IMAGE_SAMPLER, stages });
+        }
+    };
+    addSamplers(BindingPoints::PER_VIEW, SibGenerator::getPerViewSib(), STAGE_FRAGMENT);
+    addSamplers(BindingPoints::PER_MATERIAL_INSTANCE, material.sib, ALL_STAGES);
+
+    for (auto& set : mSets) {
+        std::sort(set.bindings.begin(), set.bindings.end(),
+                [](DescriptorBinding const& lhs, DescriptorBinding const& rhs) {
+            return lhs.binding < rhs.binding;
+        });
+    }
+}
+
+uint32_t DescriptorLayoutCache::GetId(const DescriptorSetLayout& layout)
+{
+    const uint64_t key = layout.GetHash();
+    std::lock_guard<std::mutex> lock(mLock);
+    auto range = mIds.equal_range(key);
+    for (auto itr = range.first; itr != range.second; ++itr) {
+        if (mLayouts[itr->second] == layout) {
+            return itr->second;
+        }
+    }
+    const uint32_t id = uint32_t(mLayouts.size());
+    mLayouts.push_back(layout);
+    mIds.emplace(key, id);
+    return id;
+}
+
+const DescriptorSetLayout& DescriptorLayoutCache::GetLayout(uint32_t id) const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mLayouts[id];
+}
+
+size_t DescriptorLayoutCache::GetSize() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mLayouts.size();
+}
+
+}
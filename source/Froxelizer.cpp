@@ -0,0 +1,458 @@
+#include "pbr/Froxelizer.h"
+#include "pbr/ThreadPool.h"
+#include "pbr/Trace.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PBR_FROXELIZER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace pbr
+{
+
+static_assert(sizeof(Froxelizer::FroxelEntry) == 4, "FroxelEntry is a RG16UI texel");
+static_assert(Froxelizer::RECORD_BUFFER_ENTRY_COUNT <= 65536, "record offsets are 16 bits");
+static_assert(CONFIG_MAX_LIGHT_COUNT <= 256, "records are 8 bits");
+
+namespace
+{
+
+// Four lanes, one light each. Comparisons return the lane bits.
+#if PBR_FROXELIZER_SSE2
+
+struct float4 {
+    __m128 v;
+};
+
+inline float4 load4(const float* p) noexcept { return { _mm_loadu_ps(p) }; }
+inline float4 splat4(float f) noexcept { return { _mm_set1_ps(f) }; }
+inline float4 operator+(float4 a, float4 b) noexcept { return { _mm_add_ps(a.v, b.v) }; }
+inline float4 operator-(float4 a, float4 b) noexcept { return { _mm_sub_ps(a.v, b.v) }; }
+inline float4 operator*(float4 a, float4 b) noexcept { return { _mm_mul_ps(a.v, b.v) }; }
+inline float4 operator-(float4 a) noexcept { return { _mm_sub_ps(_mm_setzero_ps(), a.v) }; }
+inline float4 max4(float4 a, float4 b) noexcept { return { _mm_max_ps(a.v, b.v) }; }
+inline float4 sqrt4(float4 a) noexcept { return { _mm_sqrt_ps(a.v) }; }
+inline uint32_t lessEqual(float4 a, float4 b) noexcept {
+    return uint32_t(_mm_movemask_ps(_mm_cmple_ps(a.v, b.v)));
+}
+
+#else
+
+struct float4 {
+    float v[4];
+};
+
+template<typename Op>
+inline float4 apply4(float4 a, float4 b, Op op) noexcept {
+    return { { op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3]) } };
+}
+
+inline float4 load4(const float* p) noexcept { return { { p[0], p[1], p[2], p[3] } }; }
+inline float4 splat4(float f) noexcept { return { { f, f, f, f } }; }
+inline float4 operator+(float4 a, float4 b) noexcept {
+    return apply4(a, b, [](float x, float y) { return x + y; });
+}
+inline float4 operator-(float4 a, float4 b) noexcept {
+    return apply4(a, b, [](float x, float y) { return x - y; });
+}
+inline float4 operator*(float4 a, float4 b) noexcept {
+    return apply4(a, b, [](float x, float y) { return x * y; });
+}
+inline float4 operator-(float4 a) noexcept { return splat4(0.0f) - a; }
+inline float4 max4(float4 a, float4 b) noexcept {
+    return apply4(a, b, [](float x, float y) { return x > y ? x : y; });
+}
+inline float4 sqrt4(float4 a) noexcept {
+    return { { sqrtf(a.v[0]), sqrtf(a.v[1]), sqrtf(a.v[2]), sqrtf(a.v[3]) } };
+}
+inline uint32_t lessEqual(float4 a, float4 b) noexcept {
+    return uint32_t(a.v[0] <= b.v[0]) | uint32_t(a.v[1] <= b.v[1]) << 1 |
+           uint32_t(a.v[2] <= b.v[2]) << 2 | uint32_t(a.v[3] <= b.v[3]) << 3;
+}
+
+#endif
+
+inline uint32_t lowestBit(uint64_t bits) noexcept {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return uint32_t(index);
+#else
+    return uint32_t(__builtin_ctzll(bits));
+#endif
+}
+
+inline uint32_t ceilDiv(uint32_t a, uint32_t b) noexcept {
+    return (a + b - 1) / b;
+}
+
+}
+
+Froxelizer::Froxelizer()
+    : mDistancesZ(SLICE_COUNT + 1)
+    , mFroxelBuffer(FROXEL_BUFFER_ENTRY_COUNT)
+    , mRecordBuffer(RECORD_BUFFER_ENTRY_COUNT)
+{
+    memset(mGroups, 0, sizeof(mGroups));
+}
+
+void Froxelizer::SetViewport(uint32_t left, uint32_t bottom, uint32_t width,
+                             uint32_t height) noexcept
+{
+    const uint32_t viewport[4] = { left, bottom, std::max(width, 1u), std::max(height, 1u) };
+    if (memcmp(viewport, mViewport, sizeof(viewport)) != 0) {
+        memcpy(mViewport, viewport, sizeof(viewport));
+        mDirty = true;
+    }
+}
+
+void Froxelizer::SetProjection(const float clipFromView[16], float zLightNear,
+                               float zLightFar) noexcept
+{
+    if (memcmp(clipFromView, mProjection, sizeof(mProjection)) != 0 ||
+            zLightNear != mZLightNear || zLightFar != mZLightFar) {
+        memcpy(mProjection, clipFromView, sizeof(mProjection));
+        mZLightNear = zLightNear;
+        mZLightFar = zLightFar;
+        mDirty = true;
+    }
+}
+
+bool Froxelizer::Update() noexcept
+{
+    // square froxels, as small as the froxel buffer allows. One more slice than the grid is left
+    // empty, for the fragments past the far distance.
+    const uint32_t width = mViewport[2];
+    const uint32_t height = mViewport[3];
+    const uint32_t planeCount = FROXEL_BUFFER_ENTRY_COUNT / (SLICE_COUNT + 1);
+    uint32_t dimension = std::max(1u, uint32_t(ceil(sqrt(double(width) * height / planeCount))));
+    while (ceilDiv(width, dimension) * ceilDiv(height, dimension) > planeCount) {
+        dimension++;
+    }
+    mCountX = ceilDiv(width, dimension);
+    mCountY = ceilDiv(height, dimension);
+    std::fill(mFroxelBuffer.begin(), mFroxelBuffer.end(), FroxelEntry{ 0, 0, 0 });
+
+    // view space z = -d projects to the depth z_ndc = -A + B / d
+    const float* p = mProjection;
+    const float p00 = p[0], p11 = p[5], p20 = p[8], p21 = p[9];
+    const float A = p[10], B = p[14];
+    if (p[11] != -1.0f || p[15] != 0.0f || p00 == 0.0f || p11 == 0.0f || B == 0.0f) {
+        std::cerr << "ERROR: Froxelizer needs a perspective projection" << std::endl;
+        mCountX = mCountY = 0;
+        return false;
+    }
+    // the far plane of the projection, there is none when A == -1
+    const float zProjectionFar = 1.0f + A != 0.0f ? B / (1.0f + A) : INFINITY;
+    const float zFar = std::min(zProjectionFar, mZLightFar);
+    if (!(zFar > 0.0f) || !isfinite(zFar)) {
+        std::cerr << "ERROR: Froxelizer needs a finite far distance, see zLightFar" << std::endl;
+        mCountX = mCountY = 0;
+        return false;
+    }
+
+    // the plane through the eye and the screen column (row) at t in NDC, the distance is positive
+    // on the right (top) side
+    auto makePlanes = [](std::vector<float>& planes, uint32_t count, uint32_t dimension,
+                         uint32_t size, float scale, float offset) {
+        planes.resize((count + 1) * 2);
+        for (uint32_t i = 0; i <= count; i++) {
+            const float t = 2.0f * float(i * dimension) / float(size) - 1.0f;
+            const float n = scale, nz = offset + t;
+            const float length = sqrtf(n * n + nz * nz);
+            planes[i * 2 + 0] = n / length;
+            planes[i * 2 + 1] = nz / length;
+        }
+    };
+    makePlanes(mPlanesX, mCountX, dimension, width, p00, p20);
+    makePlanes(mPlanesY, mCountY, dimension, height, p11, p21);
+
+    // slice 0 ends at zLightNear, the others are exponential up to the far distance
+    const float zLightNear = std::min(std::max(mZLightNear, 1e-3f), zFar * 0.5f);
+    const float linearizer = log2f(zFar / zLightNear) / float(SLICE_COUNT - 1);
+    mDistancesZ[0] = 0.0f;
+    for (uint32_t i = 1; i <= SLICE_COUNT; i++) {
+        mDistancesZ[i] = zFar * exp2f((float(i) - float(SLICE_COUNT)) * linearizer);
+    }
+
+    // light_punctual.fs: slice = log2(zParams.x * depth + zParams.y) * zParams.z + zParams.w
+    // with 1 / d = (2 * depth - 1 + A) / B
+    ViewParams& params = mViewParams;
+    params.zParams[0] = 2.0f / B;
+    params.zParams[1] = (A - 1.0f) / B;
+    params.zParams[2] = -1.0f / linearizer;
+    params.zParams[3] = float(SLICE_COUNT) - log2f(zFar) / linearizer;
+    params.fParamsX = 1;
+    params.fParams[0] = mCountX;
+    params.fParams[1] = mCountX * mCountY;
+    params.origin[0] = float(mViewport[0]);
+    params.origin[1] = float(mViewport[1]);
+    params.oneOverFroxelDimension = 1.0f / float(dimension);
+    params.oneOverFroxelDimensionY = 1.0f / float(dimension);
+
+    // bounding spheres of the froxels, from their corners
+    mBounds.resize(size_t(GetFroxelCount()) * 4);
+    float* bounds = mBounds.data();
+    for (uint32_t iz = 0; iz < SLICE_COUNT; iz++) {
+        for (uint32_t iy = 0; iy < mCountY; iy++) {
+            for (uint32_t ix = 0; ix < mCountX; ix++) {
+                float corners[8][3];
+                for (uint32_t c = 0; c < 8; c++) {
+                    const float d = mDistancesZ[iz + (c >> 2)];
+                    const float tx = 2.0f * float((ix + (c & 1)) * dimension) / width - 1.0f;
+                    const float ty =
+                            2.0f * float((iy + ((c >> 1) & 1)) * dimension) / height - 1.0f;
+                    corners[c][0] = d * (tx + p20) / p00;
+                    corners[c][1] = d * (ty + p21) / p11;
+                    corners[c][2] = -d;
+                }
+                float center[3];
+                for (uint32_t k = 0; k < 3; k++) {
+                    float lo = corners[0][k], hi = corners[0][k];
+                    for (uint32_t c = 1; c < 8; c++) {
+                        lo = std::min(lo, corners[c][k]);
+                        hi = std::max(hi, corners[c][k]);
+                    }
+                    center[k] = (lo + hi) * 0.5f;
+                }
+                float radius2 = 0.0f;
+                for (uint32_t c = 0; c < 8; c++) {
+                    const float dx = corners[c][0] - center[0];
+                    const float dy = corners[c][1] - center[1];
+                    const float dz = corners[c][2] - center[2];
+                    radius2 = std::max(radius2, dx * dx + dy * dy + dz * dz);
+                }
+                bounds[0] = center[0];
+                bounds[1] = center[1];
+                bounds[2] = center[2];
+                bounds[3] = sqrtf(radius2);
+                bounds += 4;
+            }
+        }
+    }
+
+    mLightMasks.resize(GetFroxelCount());
+    return true;
+}
+
+bool Froxelizer::Froxelize(ThreadPool& pool, const float viewFromWorld[16], const Light* lights,
+                           size_t count)
+{
+    PBR_TRACE_SCOPE("Froxelizer::Froxelize");
+
+    // a failed update is tried again on the next call
+    if (mDirty) {
+        mDirty = !Update();
+    }
+    if (GetFroxelCount() == 0) {
+        mRecordCount = 0;
+        return false;
+    }
+    if (count > CONFIG_MAX_LIGHT_COUNT) {
+        std::cerr << "WARNING: " << count << " lights exceed the max light count of "
+                  << CONFIG_MAX_LIGHT_COUNT << std::endl;
+        count = CONFIG_MAX_LIGHT_COUNT;
+    }
+
+    // lights to view space, in groups of four
+    const float* m = viewFromWorld;
+    const size_t groupCount = (count + 3) / 4;
+    for (size_t g = 0; g < groupCount; g++) {
+        LightGroup& group = mGroups[g];
+        group.valid = 0;
+        group.spot = 0;
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            const size_t index = g * 4 + lane;
+            if (index >= count) {
+                group.x[lane] = group.y[lane] = group.z[lane] = group.radius[lane] = 0.0f;
+                continue;
+            }
+            const Light& light = lights[index];
+            const float* pos = light.position;
+            const float* dir = light.direction;
+            group.x[lane] = m[0] * pos[0] + m[4] * pos[1] + m[8]  * pos[2] + m[12];
+            group.y[lane] = m[1] * pos[0] + m[5] * pos[1] + m[9]  * pos[2] + m[13];
+            group.z[lane] = m[2] * pos[0] + m[6] * pos[1] + m[10] * pos[2] + m[14];
+            group.radius[lane] = light.radius;
+            group.dirX[lane] = m[0] * dir[0] + m[4] * dir[1] + m[8]  * dir[2];
+            group.dirY[lane] = m[1] * dir[0] + m[5] * dir[1] + m[9]  * dir[2];
+            group.dirZ[lane] = m[2] * dir[0] + m[6] * dir[1] + m[10] * dir[2];
+            group.cosAngle[lane] = light.cosOuterAngle;
+            group.sinAngle[lane] =
+                    sqrtf(std::max(0.0f, 1.0f - light.cosOuterAngle * light.cosOuterAngle));
+            group.valid |= 1u << lane;
+            // cones wider than a hemisphere are only culled as spheres
+            if (light.spot && light.cosOuterAngle > 0.0f) {
+                group.spot |= 1u << lane;
+            }
+        }
+    }
+
+    std::fill(mLightMasks.begin(), mLightMasks.end(), LightMask{});
+    if (groupCount) {
+        pool.ParallelFor(SLICE_COUNT, [this, groupCount](size_t slice) {
+            FroxelizeSlice(uint32_t(slice), groupCount);
+        });
+    }
+
+    memset(mSpotBits, 0, sizeof(mSpotBits));
+    for (size_t g = 0; g < groupCount; g++) {
+        mSpotBits[g / 16] |= uint64_t(mGroups[g].spot) << ((g % 16) * 4);
+    }
+    return AssignRecords();
+}
+
+void Froxelizer::FroxelizeSlice(uint32_t slice, size_t groupCount) noexcept
+{
+    PBR_TRACE_SCOPE("Froxelizer::FroxelizeSlice");
+
+    const float4 dNear = splat4(mDistancesZ[slice]);
+    const float4 dFar = splat4(mDistancesZ[slice + 1]);
+    const uint32_t planeCount = FROXEL_BUFFER_ENTRY_COUNT / SLICE_COUNT;
+    // lane bits of the lights touching each column and row of the slice
+    uint8_t columns[planeCount];
+    uint8_t rows[planeCount];
+
+    auto intersectPlanes = [](const float* planes, uint32_t count, float4 u, float4 z, float4 r,
+                              uint8_t* cells) {
+        uint32_t previousInside = 0;
+        for (uint32_t i = 0; i <= count; i++) {
+            const float4 distance = splat4(planes[i * 2]) * u + splat4(planes[i * 2 + 1]) * z;
+            // right of (above) plane i and left of (below) plane i + 1
+            const uint32_t inside = lessEqual(-r, distance);
+            if (i > 0) {
+                cells[i - 1] = uint8_t(previousInside & lessEqual(distance, r));
+            }
+            previousInside = inside;
+        }
+    };
+
+    LightMask* masks = mLightMasks.data() + size_t(slice) * mCountX * mCountY;
+    const float* bounds = mBounds.data() + size_t(slice) * mCountX * mCountY * 4;
+    for (size_t g = 0; g < groupCount; g++) {
+        const LightGroup& group = mGroups[g];
+        const float4 x = load4(group.x);
+        const float4 y = load4(group.y);
+        const float4 z = load4(group.z);
+        const float4 r = load4(group.radius);
+        const float4 d = -z;
+
+        const uint32_t inSlice = lessEqual(d - r, dFar) & lessEqual(dNear, d + r) & group.valid;
+        if (!inSlice) {
+            continue;
+        }
+        intersectPlanes(mPlanesX.data(), mCountX, x, z, r, columns);
+        intersectPlanes(mPlanesY.data(), mCountY, y, z, r, rows);
+
+        const uint32_t word = uint32_t(g / 16);
+        const uint32_t shift = uint32_t(g % 16) * 4;
+        for (uint32_t iy = 0; iy < mCountY; iy++) {
+            const uint32_t inRow = inSlice & rows[iy];
+            if (!inRow) {
+                continue;
+            }
+            for (uint32_t ix = 0; ix < mCountX; ix++) {
+                uint32_t lanes = inRow & columns[ix];
+                if (!lanes) {
+                    continue;
+                }
+                const size_t froxel = size_t(iy) * mCountX + ix;
+                const float* sphere = bounds + froxel * 4;
+                const float4 sx = splat4(sphere[0]);
+                const float4 sy = splat4(sphere[1]);
+                const float4 sz = splat4(sphere[2]);
+                const float4 sr = splat4(sphere[3]);
+
+                // light sphere against the froxel sphere
+                const float4 vx = sx - x;
+                const float4 vy = sy - y;
+                const float4 vz = sz - z;
+                const float4 vv = vx * vx + vy * vy + vz * vz;
+                const float4 rr = r + sr;
+                lanes &= lessEqual(vv, rr * rr);
+
+                // spot cone against the froxel sphere
+                if (lanes & group.spot) {
+                    const float4 v1 = vx * load4(group.dirX) + vy * load4(group.dirY) +
+                                      vz * load4(group.dirZ);
+                    const float4 closest = load4(group.cosAngle) *
+                            sqrt4(max4(vv - v1 * v1, splat4(0.0f))) - v1 * load4(group.sinAngle);
+                    const uint32_t inCone = lessEqual(closest, sr) & lessEqual(-sr, v1);
+                    lanes &= ~group.spot | inCone;
+                }
+
+                if (lanes) {
+                    masks[froxel].bits[word] |= uint64_t(lanes) << shift;
+                }
+            }
+        }
+    }
+}
+
+bool Froxelizer::AssignRecords() noexcept
+{
+    PBR_TRACE_SCOPE("Froxelizer::AssignRecords");
+
+    bool overflow = false;
+    bool capped = false;
+    size_t recordCount = 0;
+    uint8_t* records = mRecordBuffer.data();
+    const uint32_t froxelCount = GetFroxelCount();
+    for (uint32_t f = 0; f < froxelCount; f++) {
+        const LightMask& mask = mLightMasks[f];
+        // neighbors often see the same lights, they then share their records
+        if (f > 0 && memcmp(&mask, &mLightMasks[f - 1], sizeof(mask)) == 0) {
+            mFroxelBuffer[f] = mFroxelBuffer[f - 1];
+            continue;
+        }
+
+        FroxelEntry entry = { uint16_t(recordCount), 0, 0 };
+        for (uint32_t spots = 0; spots < 2 && !overflow; spots++) {
+            uint32_t lightCount = 0;
+            for (size_t w = 0; w < LIGHT_WORDS; w++) {
+                uint64_t bits = mask.bits[w] & (spots ? mSpotBits[w] : ~mSpotBits[w]);
+                for ( ; bits; bits &= bits - 1, lightCount++) {
+                    // the counts are 8 bits in light_froxels
+                    if (lightCount == 255) {
+                        capped = true;
+                        break;
+                    }
+                    if (recordCount == RECORD_BUFFER_ENTRY_COUNT) {
+                        overflow = true;
+                        break;
+                    }
+                    records[recordCount++] = uint8_t(w * 64 + lowestBit(bits));
+                }
+            }
+            (spots ? entry.spotCount : entry.pointCount) = uint8_t(lightCount);
+        }
+        if (overflow) {
+            recordCount = entry.recordOffset;
+            entry = { 0, 0, 0 };
+        }
+        mFroxelBuffer[f] = entry;
+    }
+    mRecordCount = recordCount;
+
+    if (overflow) {
+        std::cerr << "WARNING: Froxel record buffer overflow, some froxels have no lights"
+                  << std::endl;
+    }
+    if (capped) {
+        std::cerr << "WARNING: More than 255 point or spot lights in a froxel, some are dropped"
+                  << std::endl;
+    }
+    return !overflow && !capped;
+}
+
+}
@@ -0,0 +1,467 @@
+#include "pbr/GLSLMinifier.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <ctype.h>
+#include <string.h>
+
+namespace
+{
+
+enum class TokenType
+{
+    DIRECTIVE,      // a whole preprocessor line
+    WORD,           // identifier or number
+    PUNCTUATION,    // an operator or a single character
+};
+
+struct Token
+{
+    TokenType type;
+    std::string text;
+    bool identifier;
+    bool removed;
+};
+
+// A function definition, as indices in the token list.
+struct Function
+{
+    size_t begin;   // first token of the return type
+    size_t name;
+    size_t end;     // closing brace of the body, or semicolon of a prototype
+    bool prototype;
+};
+
+const char* const OPERATORS[] = {
+    "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "^^",
+    "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", "<<=", ">>="
+};
+
+const char* const SHORT_NAME_KEYWORDS[] = { "if", "do", "in", "out", "for", "int", "asm" };
+
+bool isIdentifierChar(char c)
+{
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isOperatorChar(char c)
+{
+    return strchr("+-*/%<>=!&|^", c) != nullptr;
+}
+
+bool startsWith(const std::string& str, const char* prefix)
+{
+    return str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+bool isPunctuation(const Token& token, char c)
+{
+    return token.type == TokenType::PUNCTUATION && token.text.size() == 1 && token.text[0] == c;
+}
+
+// Reads a preprocessor line starting at src[i], without its comments and with its continuations
+// joined and whitespace collapsed.
+std::string readDirective(const std::string& src, size_t& i)
+{
+    const size_t n = src.size();
+    std::string text;
+    while (i < n && src[i] != '\n')
+    {
+        char c = src[i];
+        if (c == '\\' && i + 1 < n && src[i + 1] == '\n') {
+            c = ' ';
+            i += 2;
+        } else if (c == '/' && i + 1 < n && src[i + 1] == '/') {
+            while (i < n && src[i] != '\n') {
+                i++;
+            }
+            break;
+        } else if (c == '/' && i + 1 < n && src[i + 1] == '*') {
+            size_t end = src.find("*/", i + 2);
+            i = end == std::string::npos ? n : end + 2;
+            c = ' ';
+        } else {
+            i++;
+        }
+
+        if (isspace(static_cast<unsigned char>(c))) {
+            // "# define" is "#define"
+            if (text.size() > 1 && text.back() != ' ') {
+                text += ' ';
+            }
+        } else {
+            text += c;
+        }
+    }
+    if (!text.empty() && text.back() == ' ') {
+        text.pop_back();
+    }
+    return text;
+}
+
+void tokenize(const std::string& src, std::vector<Token>& tokens)
+{
+    const size_t n = src.size();
+    size_t i = 0;
+    bool lineStart = true;
+    while (i < n)
+    {
+        const char c = src[i];
+        if (c == '\n') {
+            lineStart = true;
+            i++;
+            continue;
+        }
+        if (isspace(static_cast<unsigned char>(c))) {
+            i++;
+            continue;
+        }
+        if (c == '/' && i + 1 < n && src[i + 1] == '/') {
+            while (i < n && src[i] != '\n') {
+                i++;
+            }
+            continue;
+        }
+        if (c == '/' && i + 1 < n && src[i + 1] == '*') {
+            size_t end = src.find("*/", i + 2);
+            i = end == std::string::npos ? n : end + 2;
+            continue;
+        }
+        if (c == '#' && lineStart) {
+            std::string text = readDirective(src, i);
+            // line numbers are meaningless once minified
+            if (text != "#" && !startsWith(text, "#line")) {
+                tokens.push_back({ TokenType::DIRECTIVE, text, false, false });
+            }
+            continue;
+        }
+        lineStart = false;
+
+        const bool number = isdigit(static_cast<unsigned char>(c)) ||
+                (c == '.' && i + 1 < n && isdigit(static_cast<unsigned char>(src[i + 1])));
+        if (number || isIdentifierChar(c))
+        {
+            const bool hex = number && c == '0' && i + 1 < n &&
+                    (src[i + 1] == 'x' || src[i + 1] == 'X');
+            const size_t begin = i;
+            while (i < n)
+            {
+                const char d = src[i];
+                if (isIdentifierChar(d) || (number && d == '.')) {
+                    i++;
+                } else if (number && !hex && (d == '+' || d == '-') &&
+                           (src[i - 1] == 'e' || src[i - 1] == 'E')) {
+                    i++;
+                } else {
+                    break;
+                }
+            }
+            tokens.push_back({ TokenType::WORD, src.substr(begin, i - begin), !number, false });
+            continue;
+        }
+
+        // operators are read whole, so that "i++" isn't taken for "i + +"
+        size_t size = 1;
+        for (const char* op : OPERATORS) {
+            const size_t len = strlen(op);
+            if (len > size && src.compare(i, len, op) == 0) {
+                size = len;
+            }
+        }
+        tokens.push_back({ TokenType::PUNCTUATION, src.substr(i, size), false, false });
+        i += size;
+    }
+}
+
+// Returns the index of the token closing the bracket opened at tokens[i], or tokens.size().
+size_t findClosing(const std::vector<Token>& tokens, size_t i, char open, char close,
+                   bool allowDirectives)
+{
+    int depth = 0;
+    for (; i < tokens.size(); i++)
+    {
+        const Token& t = tokens[i];
+        if (t.type == TokenType::DIRECTIVE) {
+            if (!allowDirectives) {
+                return tokens.size();
+            }
+        } else if (isPunctuation(t, open)) {
+            depth++;
+        } else if (isPunctuation(t, close)) {
+            if (--depth == 0) {
+                return i;
+            }
+        }
+    }
+    return tokens.size();
+}
+
+// Finds the function definitions and prototypes at global scope.
+void findFunctions(const std::vector<Token>& tokens, std::vector<Function>& functions)
+{
+    int depth = 0;
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        const Token& t = tokens[i];
+        if (isPunctuation(t, '{')) {
+            depth++;
+            continue;
+        }
+        if (isPunctuation(t, '}')) {
+            depth--;
+            continue;
+        }
+        if (depth != 0 || !t.identifier || i + 1 >= tokens.size() ||
+            !isPunctuation(tokens[i + 1], '(')) {
+            continue;
+        }
+
+        // a declaration has a return type (and maybe a precision) in front of the name, which
+        // rules out e.g. layout(...) and constructors in initializers
+        size_t begin = i;
+        while (begin > 0 && tokens[begin - 1].identifier) {
+            begin--;
+        }
+        if (begin == i) {
+            continue;
+        }
+        if (begin > 0) {
+            const Token& before = tokens[begin - 1];
+            if (before.type != TokenType::DIRECTIVE && !isPunctuation(before, ';') &&
+                !isPunctuation(before, '}')) {
+                continue;
+            }
+        }
+
+        size_t params = findClosing(tokens, i + 1, '(', ')', false);
+        if (params + 1 >= tokens.size()) {
+            continue;
+        }
+        if (isPunctuation(tokens[params + 1], ';')) {
+            functions.push_back({ begin, i, params + 1, true });
+            i = params + 1;
+        } else if (isPunctuation(tokens[params + 1], '{')) {
+            size_t end = findClosing(tokens, params + 1, '{', '}', true);
+            if (end == tokens.size()) {
+                continue;
+            }
+            functions.push_back({ begin, i, end, false });
+            i = end;
+        }
+    }
+}
+
+// True if the conditional directives in tokens[begin, end] open and close within the range,
+// i.e. the range can be dropped without unbalancing the program's #if/#endif.
+bool hasBalancedConditionals(const std::vector<Token>& tokens, size_t begin, size_t end)
+{
+    int depth = 0;
+    for (size_t i = begin; i <= end; i++)
+    {
+        const Token& t = tokens[i];
+        if (t.type != TokenType::DIRECTIVE) {
+            continue;
+        }
+        if (startsWith(t.text, "#if")) {
+            depth++;
+        } else if (startsWith(t.text, "#endif")) {
+            if (--depth < 0) {
+                return false;
+            }
+        } else if (depth == 0 && (startsWith(t.text, "#else") || startsWith(t.text, "#elif"))) {
+            return false;
+        }
+    }
+    return depth == 0;
+}
+
+std::string shortName(size_t index)
+{
+    std::string name;
+    do {
+        name.insert(name.begin(), char('a' + index % 26));
+        index /= 26;
+    } while (index-- > 0);
+    return name;
+}
+
+void renameLocals(std::vector<Token>& tokens, const std::vector<Function>& functions,
+                  const pbr::GLSLMinifier::Symbols& symbols)
+{
+    // a short name must not hide anything the program refers to, and a local that a macro
+    // refers to keeps its name since macros are not rewritten
+    std::unordered_set<std::string> used;
+    std::unordered_set<std::string> macros;
+    for (auto const& t : tokens)
+    {
+        if (t.identifier) {
+            used.insert(t.text);
+        } else if (t.type == TokenType::DIRECTIVE) {
+            for (size_t i = 0; i < t.text.size(); )
+            {
+                if (isalpha(static_cast<unsigned char>(t.text[i])) || t.text[i] == '_') {
+                    size_t begin = i;
+                    while (i < t.text.size() && isIdentifierChar(t.text[i])) {
+                        i++;
+                    }
+                    std::string id = t.text.substr(begin, i - begin);
+                    used.insert(id);
+                    macros.insert(id);
+                } else {
+                    i++;
+                }
+            }
+        }
+    }
+    for (const char* keyword : SHORT_NAME_KEYWORDS) {
+        used.insert(keyword);
+    }
+
+    // nor may a local that shares its name with something declared out of the functions, the
+    // function could use both
+    std::vector<bool> inFunction(tokens.size(), false);
+    for (auto const& f : functions) {
+        if (!f.prototype) {
+            std::fill(inFunction.begin() + f.name + 1, inFunction.begin() + f.end + 1, true);
+        }
+    }
+    std::unordered_set<std::string> globals;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        if (!inFunction[i] && tokens[i].identifier) {
+            globals.insert(tokens[i].text);
+        }
+    }
+
+    for (auto const& f : functions)
+    {
+        if (f.prototype || tokens[f.begin].removed) {
+            continue;
+        }
+        auto itr = symbols.locals.find(tokens[f.name].text);
+        if (itr == symbols.locals.end()) {
+            continue;
+        }
+
+        std::unordered_map<std::string, std::string> names;
+        size_t next = 0;
+        for (auto const& local : itr->second)
+        {
+            if (macros.count(local) || globals.count(local)) {
+                continue;
+            }
+            std::string name;
+            do {
+                name = shortName(next++);
+            } while (used.count(name));
+            if (name.size() < local.size()) {
+                names[local] = name;
+            } else {
+                next--;
+            }
+        }
+
+        for (size_t i = f.name + 1; i <= f.end; i++)
+        {
+            Token& t = tokens[i];
+            if (!t.identifier || isPunctuation(tokens[i - 1], '.')) {
+                continue;
+            }
+            auto name = names.find(t.text);
+            if (name != names.end()) {
+                t.text = name->second;
+            }
+        }
+    }
+}
+
+bool needsSpace(const Token& prev, const Token& next)
+{
+    if (prev.type == TokenType::WORD && next.type == TokenType::WORD) {
+        return true;
+    }
+    // keep e.g. "a - -b" from becoming "a--b"
+    return prev.type == TokenType::PUNCTUATION && next.type == TokenType::PUNCTUATION &&
+        isOperatorChar(prev.text.back()) && isOperatorChar(next.text[0]);
+}
+
+}
+
+namespace pbr
+{
+
+std::string GLSLMinifier::Minify(const std::string& shader, const Symbols& symbols) const noexcept
+{
+    std::vector<Token> tokens;
+    tokenize(shader, tokens);
+
+    std::vector<Function> functions;
+    findFunctions(tokens, functions);
+
+    // Without the AST's call graph (e.g. no main()) every function stays.
+    if (!symbols.functions.empty())
+    {
+        for (auto const& f : functions)
+        {
+            const std::string& name = tokens[f.name].text;
+            if (name == "main" || symbols.functions.count(name) ||
+                !hasBalancedConditionals(tokens, f.begin, f.end)) {
+                continue;
+            }
+            for (size_t i = f.begin; i <= f.end; i++) {
+                tokens[i].removed = true;
+            }
+        }
+    }
+
+    if (mRenameLocals) {
+        renameLocals(tokens, functions, symbols);
+    }
+
+    std::string out;
+    out.reserve(shader.size() / 2);
+    const Token* prev = nullptr;
+    int depth = 0;
+    bool functionBody = false;
+    for (auto const& t : tokens)
+    {
+        if (t.removed) {
+            continue;
+        }
+        if (t.type == TokenType::DIRECTIVE)
+        {
+            if (!out.empty() && out.back() != '\n') {
+                out += '\n';
+            }
+            out += t.text;
+            out += '\n';
+            prev = &t;
+            continue;
+        }
+
+        if (prev && prev->type != TokenType::DIRECTIVE && out.back() != '\n' &&
+            needsSpace(*prev, t)) {
+            out += ' ';
+        }
+        out += t.text;
+
+        // one line per global declaration and function keeps lines reasonably short
+        if (isPunctuation(t, '{')) {
+            if (depth++ == 0) {
+                functionBody = prev && isPunctuation(*prev, ')');
+            }
+        } else if (isPunctuation(t, '}')) {
+            if (--depth == 0 && functionBody) {
+                out += '\n';
+            }
+        } else if (isPunctuation(t, ';') && depth == 0) {
+            out += '\n';
+        }
+        prev = &t;
+    }
+    return out;
+}
+
+}
@@ -23,10 +23,17 @@
 #include <glslang/Include/intermediate.h>
 #include <glslang/Include/ResourceLimits.h>
 #include <glslang/MachineIndependent/localintermediate.h>
+#include <SPIRV/GlslangToSpv.h>
 
 #include "pbr/builtinResource.h"
+#include "pbr/ThreadPool.h"
+#include "pbr/Trace.h"
 
+#include <algorithm>
 #include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
 
 namespace
 {
@@ -69,93 +76,518 @@ EShMessages glslangFlagsFromTargetApi(pbr::MaterialBuilder::TargetApi targetApi)
     return msg;
 }
 
+// glslang's process state (keyword maps, built-in symbol tables) is set up once and kept until
+// the process exits. ShInitialize() takes a global lock and is reference counted, calling it for
+// every shader only serializes concurrent validations.
+void initGlslang()
+{
+    static std::once_flag once;
+    std::call_once(once, []() { ShInitialize(); });
 }
 
-namespace pbr
+bool analyzeFragment(TIntermNode& root, std::ostream& err) noexcept
 {
+    // Check there is a material function definition in this shader.
+    TIntermNode* materialFctNode = ASTUtils::getFunctionByNameOnly("material", root);
+    if (materialFctNode == nullptr) {
+        err << "ERROR: Invalid fragment shader:" << std::endl;
+        err << "ERROR: Unable to find material() function" << std::endl;
+        return false;
+    }
 
-bool GLSLTools::AnalyzeFragmentShader(const std::string& shaderCode, ShaderModel model,
-                                      MaterialBuilder::TargetApi targetApi) const noexcept
+    // Check there is a prepareMaterial function defintion in this shader.
+    glslang::TIntermAggregate* prepareMaterialNode =
+            ASTUtils::getFunctionByNameOnly("prepareMaterial", root);
+    if (prepareMaterialNode == nullptr) {
+        err << "ERROR: Invalid fragment shader:" << std::endl;
+        err << "ERROR: Unable to find prepareMaterial() function" << std::endl;
+        return false;
+    }
+
+    std::string prepareMaterialSignature = prepareMaterialNode->getName().c_str();
+    bool prepareMaterialCalled = ASTUtils::isFunctionCalled(prepareMaterialSignature,
+            *materialFctNode, root);
+    if (!prepareMaterialCalled) {
+        err << "ERROR: Invalid fragment shader:" << std::endl;
+        err << "ERROR: prepareMaterial() is not called" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool analyzeVertex(TIntermNode& root, std::ostream& err) noexcept
 {
-    ShInitialize();
+    // Check there is a material function definition in this shader.
+    TIntermNode* materialFctNode = ASTUtils::getFunctionByNameOnly("materialVertex", root);
+    if (materialFctNode == nullptr) {
+        err << "ERROR: Invalid vertex shader" << std::endl;
+        err << "ERROR: Unable to find materialVertex() function" << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    // Parse to check syntax and semantic.
-    const char* shaderCString = shaderCode.c_str();
+// MaterialInputs field of each MaterialBuilder::Property.
+const char* const PROPERTY_FIELDS[pbr::MaterialBuilder::MATERIAL_PROPERTIES_COUNT] = {
+    "baseColor",
+    "roughness",
+    "metallic",
+    "reflectance",
+    "ambientOcclusion",
+    "clearCoat",
+    "clearCoatRoughness",
+    "clearCoatNormal",
+    "anisotropy",
+    "anisotropyDirection",
+    "thickness",
+    "subsurfacePower",
+    "subsurfaceColor",
+    "sheenColor",
+    "specularColor",
+    "glossiness",
+    "emissive",
+    "normal",
+    "postLightingColor",
+};
 
-    glslang::TShader tShader(EShLanguage::EShLangFragment);
-    tShader.setStrings(&shaderCString, 1);
+// Sets the properties written through parameter parameterIdx of the function with the given
+// glslang mangled signature, following the calls that parameter is passed to.
+bool findPropertyWrites(const std::string& functionSignature, size_t parameterIdx,
+                        TIntermNode& root, pbr::MaterialBuilder::PropertyList& properties,
+                        std::ostream& err) noexcept
+{
+    glslang::TIntermAggregate* function = ASTUtils::getFunctionBySignature(functionSignature, root);
+    if (function == nullptr) {
+        err << "ERROR: Unable to find function " << functionSignature << std::endl;
+        return false;
+    }
 
-    GLSLangCleaner cleaner;
-    int version = glslangVersionFromShaderModel(model);
-    EShMessages msg = glslangFlagsFromTargetApi(targetApi);
-    bool ok = tShader.parse(&DefaultTBuiltInResource, version, false, msg);
-    if (!ok) {
-        //std::cerr << "ERROR: Unable to parse fragment shader:" << std::endl;
-        //std::cerr << tShader.getInfoLog() << utils::io::flush;
+    std::vector<ASTUtils::FunctionParameter> parameters;
+    ASTUtils::getFunctionParameters(function, parameters);
+    if (parameterIdx >= parameters.size()) {
+        err << "ERROR: Unable to find parameter " << parameterIdx << " of " << functionSignature
+            << std::endl;
         return false;
     }
 
-    TIntermNode* root = tShader.getIntermediate()->getTreeRoot();
-    // Check there is a material function definition in this shader.
-    TIntermNode* materialFctNode = ASTUtils::getFunctionByNameOnly("material", *root);
-    if (materialFctNode == nullptr) {
-        std::cerr << "ERROR: Invalid fragment shader:" << std::endl;
-        std::cerr << "ERROR: Unable to find material() function" << std::endl;
+    // only out and inout parameters can write to the material
+    auto qualifier = parameters[parameterIdx].qualifier;
+    if (qualifier != ASTUtils::FunctionParameter::OUT &&
+        qualifier != ASTUtils::FunctionParameter::INOUT) {
+        return true;
+    }
+
+    const std::string& name = parameters[parameterIdx].name;
+    std::deque<pbr::Symbol> symbols;
+    ASTUtils::traceSymbols(*function, symbols);
+    for (pbr::Symbol& symbol : symbols)
+    {
+        // assignments of the whole struct (material = other) can't be traced
+        if (symbol.getName() != name || symbol.getAccesses().empty()) {
+            continue;
+        }
+
+        // material.field = ..., or material.field passed to a function
+        if (symbol.hasDirectIndexForStruct()) {
+            const std::string field = symbol.getDirectIndexStructName();
+            for (size_t i = 0; i < pbr::MaterialBuilder::MATERIAL_PROPERTIES_COUNT; i++) {
+                if (field == PROPERTY_FIELDS[i]) {
+                    properties[i] = true;
+                }
+            }
+            continue;
+        }
+
+        // the material itself passed to a function, prepareMaterial() only reads it
+        const pbr::Access& access = symbol.getAccesses().front();
+        if (access.type == pbr::Access::FunctionCall &&
+                ASTUtils::getFunctionName(access.string) != "prepareMaterial") {
+            if (!findPropertyWrites(access.string, access.parameterIdx, root, properties, err)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool findProperties(TIntermNode& root, pbr::MaterialBuilder::PropertyList& properties,
+                    std::ostream& err) noexcept
+{
+    glslang::TIntermAggregate* material = ASTUtils::getFunctionByNameOnly("material", root);
+    if (material == nullptr) {
+        err << "ERROR: Unable to find material() function" << std::endl;
         return false;
     }
 
-    // Check there is a prepareMaterial function defintion in this shader.
-    glslang::TIntermAggregate* prepareMaterialNode = ASTUtils::getFunctionByNameOnly("prepareMaterial",
-            *root);
-    if (prepareMaterialNode == nullptr) {
-        std::cerr << "ERROR: Invalid fragment shader:" << std::endl;
-        std::cerr << "ERROR: Unable to find prepareMaterial() function" << std::endl;
+    std::fill_n(properties, pbr::MaterialBuilder::MATERIAL_PROPERTIES_COUNT, false);
+    if (!findPropertyWrites(material->getName().c_str(), 0, root, properties, err)) {
         return false;
     }
 
-    std::string prepareMaterialSignature = prepareMaterialNode->getName().c_str();
-    bool prepareMaterialCalled = ASTUtils::isFunctionCalled(prepareMaterialSignature,
-            *materialFctNode, *root);
-    if (!prepareMaterialCalled) {
-        std::cerr << "ERROR: Invalid fragment shader:" << std::endl;
-        std::cerr << "ERROR: prepareMaterial() is not called" << std::endl;
+    // the clear coat normal and the anisotropy direction only exist along with the clear coat
+    // and the anisotropy
+    using Property = pbr::MaterialBuilder::Property;
+    if (properties[size_t(Property::CLEAR_COAT_NORMAL)]) {
+        properties[size_t(Property::CLEAR_COAT)] = true;
+    }
+    if (properties[size_t(Property::ANISOTROPY_DIRECTION)]) {
+        properties[size_t(Property::ANISOTROPY)] = true;
+    }
+    return true;
+}
+
+struct AttributeUse
+{
+    const char* name;
+    pbr::VertexAttribute attribute;
+};
+
+// Getters reading a vertex attribute. The tangent frame, and the normal derived from it, are only
+// computed with the TANGENTS attribute.
+const AttributeUse ATTRIBUTE_GETTERS[] = {
+    { "getColor",                      pbr::VertexAttribute::COLOR },
+    { "getUV0",                        pbr::VertexAttribute::UV0 },
+    { "getUV1",                        pbr::VertexAttribute::UV1 },
+    { "getWorldTangentFrame",          pbr::VertexAttribute::TANGENTS },
+    { "getWorldNormalVector",          pbr::VertexAttribute::TANGENTS },
+    { "getWorldGeometricNormalVector", pbr::VertexAttribute::TANGENTS },
+    { "getWorldReflectedVector",       pbr::VertexAttribute::TANGENTS },
+    { "getNdotV",                      pbr::VertexAttribute::TANGENTS },
+};
+
+// MaterialVertexInputs fields holding a vertex attribute.
+const AttributeUse ATTRIBUTE_FIELDS[] = {
+    { "color",       pbr::VertexAttribute::COLOR },
+    { "uv0",         pbr::VertexAttribute::UV0 },
+    { "uv1",         pbr::VertexAttribute::UV1 },
+    { "worldNormal", pbr::VertexAttribute::TANGENTS },
+};
+
+// Inserts in functions the material code of the stage: materialVertex() or material() and the
+// functions they call. prepareMaterial() isn't followed, it is part of every material.
+bool getMaterialFunctions(TIntermNode& root, bool vertex, std::set<std::string>& functions,
+                          std::ostream& err) noexcept
+{
+    const char* entryPoint = vertex ? "materialVertex" : "material";
+    if (ASTUtils::getFunctionByNameOnly(entryPoint, root) == nullptr) {
+        err << "ERROR: Unable to find " << entryPoint << "() function" << std::endl;
         return false;
     }
+    ASTUtils::getReachableFunctions(entryPoint, root, functions, { "prepareMaterial" });
+    return true;
+}
+
+// Inserts in fields the fields of structName accessed by the given functions.
+void getFieldAccesses(TIntermNode& root, const std::set<std::string>& functions,
+                      const std::string& structName, std::set<std::string>& fields) noexcept
+{
+    std::map<std::string, glslang::TIntermAggregate*> definitions;
+    ASTUtils::getFunctionDefinitions(root, definitions);
+    for (auto const& definition : definitions) {
+        if (functions.count(ASTUtils::getFunctionName(definition.first))) {
+            ASTUtils::getStructFieldAccesses(*definition.second, structName, fields);
+        }
+    }
+}
+
+// Sets the attributes read by the material code of the stage.
+bool findAttributes(TIntermNode& root, bool vertex, pbr::AttributeBitset& attributes,
+                    std::ostream& err) noexcept
+{
+    std::set<std::string> functions;
+    if (!getMaterialFunctions(root, vertex, functions, err)) {
+        return false;
+    }
+    for (auto const& getter : ATTRIBUTE_GETTERS) {
+        if (functions.count(getter.name)) {
+            attributes.set(size_t(getter.attribute));
+        }
+    }
+
+    if (vertex) {
+        std::set<std::string> fields;
+        getFieldAccesses(root, functions, "MaterialVertexInputs", fields);
+        for (auto const& field : ATTRIBUTE_FIELDS) {
+            if (fields.count(field.name)) {
+                attributes.set(size_t(field.attribute));
+            }
+        }
+    }
+    return true;
+}
 
+// Inserts the material parameters, the fields of the MaterialParams uniform block, read by the
+// material code of the stage.
+bool findParameters(TIntermNode& root, bool vertex, std::set<std::string>& parameters,
+                    std::ostream& err) noexcept
+{
+    std::set<std::string> functions;
+    if (!getMaterialFunctions(root, vertex, functions, err)) {
+        return false;
+    }
+    getFieldAccesses(root, functions, "MaterialParams", parameters);
     return true;
 }
 
-bool GLSLTools::AnalyzeVertexShader(const std::string& shaderCode, ShaderModel model,
-                                    MaterialBuilder::TargetApi targetApi) const noexcept
+void collectSymbols(TIntermNode& root, pbr::GLSLMinifier::Symbols& symbols) noexcept
+{
+    ASTUtils::getReachableFunctions("main", root, symbols.functions);
+
+    std::map<std::string, glslang::TIntermAggregate*> definitions;
+    ASTUtils::getFunctionDefinitions(root, definitions);
+    for (auto const& definition : definitions) {
+        std::string name = ASTUtils::getFunctionName(definition.first);
+        if (symbols.functions.count(name)) {
+            ASTUtils::getLocalVariables(definition.second, symbols.locals[name]);
+        }
+    }
+}
+
+// What checkShader() extracts from the AST of a valid shader, each only if not null.
+struct ShaderOutputs
+{
+    // SPIR-V translated from the AST
+    std::vector<uint32_t>* spirv = nullptr;
+    // call graph and locals, for GLSLMinifier
+    pbr::GLSLMinifier::Symbols* symbols = nullptr;
+    // properties written by material(), fragment shaders only
+    pbr::MaterialBuilder::PropertyList* properties = nullptr;
+    // attributes read by the material code, added to the set ones
+    pbr::AttributeBitset* attributes = nullptr;
+    // material parameters read by the material code, added to the set ones
+    std::set<std::string>* parameters = nullptr;
+};
+
+// Parses the shader to check its syntax and semantic, then, if analyze is set, looks for the
+// material entry points in its AST and fills in outputs. Messages are written to err, parse
+// errors only if reportParseErrors is set.
+bool checkShader(const std::string& shaderCode, pbr::ShaderType type, pbr::ShaderModel model,
+                 pbr::MaterialBuilder::TargetApi targetApi, bool analyze,
+                 const ShaderOutputs& outputs, std::ostream& err,
+                 bool reportParseErrors = true) noexcept
 {
-    ShInitialize();
+    initGlslang();
 
-    // Parse to check syntax and semantic.
     const char* shaderCString = shaderCode.c_str();
 
-    glslang::TShader tShader(EShLanguage::EShLangVertex);
+    const bool vertex = type == pbr::ShaderType::VERTEX;
+    const EShLanguage language = vertex ? EShLangVertex : EShLangFragment;
+    glslang::TShader tShader(language);
     tShader.setStrings(&shaderCString, 1);
 
-    GLSLangCleaner cleaner;
     int version = glslangVersionFromShaderModel(model);
     EShMessages msg = glslangFlagsFromTargetApi(targetApi);
-    bool ok = tShader.parse(&DefaultTBuiltInResource, version, false, msg);
+    std::vector<uint32_t>* spirv = outputs.spirv;
+    if (spirv) {
+        // the program declares its own #version, 100 is only glslang's default
+        if (targetApi == pbr::MaterialBuilder::TargetApi::VULKAN) {
+            tShader.setEnvInput(EShSourceGlsl, language, EShClientVulkan, 100);
+            tShader.setEnvClient(EShClientVulkan, EShTargetVulkan_1_0);
+        } else {
+            tShader.setEnvInput(EShSourceGlsl, language, EShClientOpenGL, 100);
+            tShader.setEnvClient(EShClientOpenGL, EShTargetOpenGL_450);
+        }
+        tShader.setEnvTarget(EShTargetSpv, EShTargetSpv_1_0);
+        msg = (EShMessages)(msg | EShMessages::EShMsgSpvRules);
+    }
+
+    GLSLangCleaner cleaner;
+    bool ok;
+    {
+        PBR_TRACE_SCOPE("glslang parse");
+        ok = tShader.parse(&DefaultTBuiltInResource, version, false, msg);
+    }
     if (!ok) {
-        std::cerr << "ERROR: Unable to parse vertex shader" << std::endl;
-        std::cerr << tShader.getInfoLog() << std::flush;
+        if (reportParseErrors) {
+            err << "ERROR: Unable to parse " << (vertex ? "vertex" : "fragment") << " shader"
+                << std::endl;
+            err << tShader.getInfoLog() << std::flush;
+        }
         return false;
     }
 
-    TIntermNode* root = tShader.getIntermediate()->getTreeRoot();
-    // Check there is a material function definition in this shader.
-    TIntermNode* materialFctNode = ASTUtils::getFunctionByNameOnly("materialVertex", *root);
-    if (materialFctNode == nullptr) {
-        std::cerr << "ERROR: Invalid vertex shader" << std::endl;
-        std::cerr << "ERROR: Unable to find materialVertex() function" << std::endl;
+    if (analyze) {
+        PBR_TRACE_SCOPE("AST analysis");
+        TIntermNode* root = tShader.getIntermediate()->getTreeRoot();
+        if (!(vertex ? analyzeVertex(*root, err) : analyzeFragment(*root, err))) {
+            return false;
+        }
+    }
+
+    TIntermNode& root = *tShader.getIntermediate()->getTreeRoot();
+    if (outputs.properties) {
+        PBR_TRACE_SCOPE("AST properties");
+        if (!findProperties(root, *outputs.properties, err)) {
+            return false;
+        }
+    }
+
+    if (outputs.attributes) {
+        PBR_TRACE_SCOPE("AST attributes");
+        if (!findAttributes(root, vertex, *outputs.attributes, err)) {
+            return false;
+        }
+    }
+
+    if (outputs.parameters) {
+        PBR_TRACE_SCOPE("AST parameters");
+        if (!findParameters(root, vertex, *outputs.parameters, err)) {
+            return false;
+        }
+    }
+
+    if (outputs.symbols) {
+        PBR_TRACE_SCOPE("AST symbols");
+        collectSymbols(root, *outputs.symbols);
+    }
+
+    if (spirv) {
+        // from the AST we just validated, linked so that the intermediate is finalized (main()
+        // present, dead functions removed) the way GlslangToSpv() expects it
+        PBR_TRACE_SCOPE("GlslangToSpv");
+        glslang::TPoolAllocator& allocator = glslang::GetThreadPoolAllocator();
+        glslang::TProgram program;
+        program.addShader(&tShader);
+        const bool linked = program.link(msg);
+        // linking may switch to the program's allocator, which dies with it
+        glslang::SetThreadPoolAllocator(&allocator);
+        if (!linked) {
+            err << "ERROR: Unable to link " << (vertex ? "vertex" : "fragment") << " shader"
+                << std::endl;
+            err << program.getInfoLog() << std::flush;
+            return false;
+        }
+        std::vector<unsigned int> words;
+        glslang::GlslangToSpv(*program.getIntermediate(language), words);
+        spirv->assign(words.begin(), words.end());
+    }
+
+    return true;
+}
+
+}
+
+namespace pbr
+{
+
+bool GLSLTools::AnalyzeFragmentShader(const std::string& shaderCode, ShaderModel model,
+                                      MaterialBuilder::TargetApi targetApi) const noexcept
+{
+    // only the analysis is reported, a program that doesn't parse fails quietly
+    return checkShader(shaderCode, ShaderType::FRAGMENT, model, targetApi, true, ShaderOutputs(),
+            std::cerr, false);
+}
+
+bool GLSLTools::AnalyzeVertexShader(const std::string& shaderCode, ShaderModel model,
+                                    MaterialBuilder::TargetApi targetApi) const noexcept
+{
+    return checkShader(shaderCode, ShaderType::VERTEX, model, targetApi, true, ShaderOutputs(),
+            std::cerr);
+}
+
+bool GLSLTools::FindProperties(const std::string& shaderCode, ShaderModel model,
+                               MaterialBuilder::TargetApi targetApi,
+                               MaterialBuilder::PropertyList& properties,
+                               AttributeBitset* attributes) const noexcept
+{
+    ShaderOutputs outputs;
+    outputs.properties = &properties;
+    outputs.attributes = attributes;
+    return checkShader(shaderCode, ShaderType::FRAGMENT, model, targetApi, true, outputs,
+            std::cerr);
+}
+
+bool GLSLTools::FindAttributes(const std::string& shaderCode, ShaderType type, ShaderModel model,
+                               MaterialBuilder::TargetApi targetApi,
+                               AttributeBitset& attributes) const noexcept
+{
+    ShaderOutputs outputs;
+    outputs.attributes = &attributes;
+    return checkShader(shaderCode, type, model, targetApi, true, outputs, std::cerr);
+}
+
+bool GLSLTools::FindParameters(const std::string& shaderCode, ShaderType type, ShaderModel model,
+                               MaterialBuilder::TargetApi targetApi,
+                               std::set<std::string>& parameters) const noexcept
+{
+    ShaderOutputs outputs;
+    outputs.parameters = &parameters;
+    return checkShader(shaderCode, type, model, targetApi, true, outputs, std::cerr);
+}
+
+bool GLSLTools::ValidateShader(const std::string& shaderCode, ShaderType type, ShaderModel model,
+                               MaterialBuilder::TargetApi targetApi) const noexcept
+{
+    return checkShader(shaderCode, type, model, targetApi, false, ShaderOutputs(), std::cerr);
+}
+
+bool GLSLTools::Preprocess(const std::string& shaderCode, ShaderType type, ShaderModel model,
+                           MaterialBuilder::TargetApi targetApi,
+                           std::string& output) const noexcept
+{
+    initGlslang();
+
+    const char* shaderCString = shaderCode.c_str();
+    glslang::TShader tShader(type == ShaderType::VERTEX ? EShLangVertex : EShLangFragment);
+    tShader.setStrings(&shaderCString, 1);
+
+    GLSLangCleaner cleaner;
+    PBR_TRACE_SCOPE("glslang preprocess");
+    glslang::TShader::ForbidIncluder includer;
+    std::string preprocessed;
+    if (!tShader.preprocess(&DefaultTBuiltInResource, glslangVersionFromShaderModel(model),
+            ENoProfile, false, false, glslangFlagsFromTargetApi(targetApi), &preprocessed,
+            includer)) {
         return false;
     }
 
+    // The preprocessor keeps the lines of the source with blank lines and #line directives,
+    // which move with every define.
+    output.clear();
+    output.reserve(preprocessed.size());
+    for (size_t begin = 0; begin < preprocessed.size(); ) {
+        size_t end = preprocessed.find('\n', begin);
+        if (end == std::string::npos) {
+            end = preprocessed.size();
+        }
+        const size_t first = preprocessed.find_first_not_of(" \t\r", begin);
+        if (first < end && preprocessed.compare(first, 5, "#line") != 0) {
+            output.append(preprocessed, first, end - first);
+            output += '\n';
+        }
+        begin = end + 1;
+    }
     return true;
 }
 
-}
\ No newline at end of file
+bool GLSLTools::ValidateShaders(ThreadPool& pool, const std::vector<ShaderSource>& shaders,
+                                std::vector<uint8_t>& results) const noexcept
+{
+    PBR_TRACE_SCOPE("GLSLTools::ValidateShaders");
+    results.assign(shaders.size(), 0);
+
+    // Messages are collected per shader and printed in order once all are done, so that the
+    // output of concurrent validations doesn't interleave.
+    std::vector<std::string> logs(shaders.size());
+    pool.ParallelFor(shaders.size(), [&](size_t i) {
+        const ShaderSource& src = shaders[i];
+        std::stringstream err;
+        ShaderOutputs outputs;
+        outputs.spirv = src.spirv;
+        outputs.symbols = src.symbols;
+        results[i] = checkShader(*src.shaderCode, src.type, src.shaderModel, src.targetApi,
+                src.analyze, outputs, err) ? 1 : 0;
+        logs[i] = err.str();
+    });
+
+    bool ok = true;
+    for (size_t i = 0; i < shaders.size(); i++) {
+        std::cerr << logs[i];
+        ok = ok && results[i];
+    }
+    std::cerr << std::flush;
+    return ok;
+}
+
+}
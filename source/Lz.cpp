@@ -0,0 +1,139 @@
+#include "pbr/Lz.h"
+
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace
+{
+
+const size_t MIN_MATCH = 4;
+const int HASH_BITS = 14;
+
+uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hashSequence(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - HASH_BITS);
+}
+
+}
+
+namespace pbr
+{
+namespace lz
+{
+
+void WriteVarint(std::string& out, size_t v)
+{
+    while (v >= 0x80) {
+        out += char(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+bool ReadVarint(const uint8_t*& p, const uint8_t* end, size_t& v) noexcept
+{
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (p == end) {
+            return false;
+        }
+        const uint8_t b = *p++;
+        v |= size_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stream of sequences: varint literal count, the literals, varint (match length - MIN_MATCH + 1)
+// and varint match offset. A match length of 0 ends the stream.
+void Compress(const void* data, size_t size, std::string& out)
+{
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    std::vector<int64_t> table(size_t(1) << HASH_BITS, -1);
+
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + MIN_MATCH <= size)
+    {
+        const uint32_t seq = read32(src + i);
+        int64_t& slot = table[hashSequence(seq)];
+        const int64_t candidate = slot;
+        slot = int64_t(i);
+        if (candidate < 0 || read32(src + candidate) != seq) {
+            i++;
+            continue;
+        }
+
+        size_t len = MIN_MATCH;
+        while (i + len < size && src[candidate + len] == src[i + len]) {
+            len++;
+        }
+
+        WriteVarint(out, i - anchor);
+        out.append(reinterpret_cast<const char*>(src + anchor), i - anchor);
+        WriteVarint(out, len - MIN_MATCH + 1);
+        WriteVarint(out, i - size_t(candidate));
+
+        i += len;
+        anchor = i;
+    }
+
+    WriteVarint(out, size - anchor);
+    out.append(reinterpret_cast<const char*>(src + anchor), size - anchor);
+    WriteVarint(out, 0);
+}
+
+bool Decompress(const void* data, size_t size, void* dst, size_t dstSize) noexcept
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    size_t written = 0;
+    while (true)
+    {
+        size_t literals;
+        if (!ReadVarint(p, end, literals) || literals > size_t(end - p) ||
+            literals > dstSize - written) {
+            return false;
+        }
+        memcpy(out + written, p, literals);
+        p += literals;
+        written += literals;
+
+        size_t match;
+        if (!ReadVarint(p, end, match)) {
+            return false;
+        }
+        if (match == 0) {
+            break;
+        }
+        const size_t len = match + MIN_MATCH - 1;
+        size_t offset;
+        if (!ReadVarint(p, end, offset) || offset == 0 || offset > written ||
+            len > dstSize - written) {
+            return false;
+        }
+        // byte by byte: the match may overlap what it produces
+        const uint8_t* from = out + written - offset;
+        for (size_t k = 0; k < len; k++) {
+            out[written + k] = from[k];
+        }
+        written += len;
+    }
+    return written == dstSize;
+}
+
+}
+}
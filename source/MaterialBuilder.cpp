@@ -20,6 +20,57 @@
 #include "pbr/MaterialInfo.h"
 #include "pbr/DriverEnums.h"
 #include "pbr/MaterialInfo.h"
+#include "pbr/ShaderCache.h"
+#include "pbr/SpirvOptimizer.h"
+#include "pbr/Hash.h"
+#include "pbr/SamplerLayers.h"
+#include "pbr/ThreadPool.h"
+#include "pbr/Trace.h"
+#include "pbr/Variant.h"
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace
+{
+
+// Attributes required according to their use by the material code, see SetAttributeInference().
+const pbr::AttributeBitset INFERRED_ATTRIBUTES(
+        (1u << uint32_t(pbr::VertexAttribute::TANGENTS)) |
+        (1u << uint32_t(pbr::VertexAttribute::COLOR)) |
+        (1u << uint32_t(pbr::VertexAttribute::UV0)) |
+        (1u << uint32_t(pbr::VertexAttribute::UV1)));
+
+// mediump floats have a 10 bits mantissa, past this magnitude they lose the fractional part.
+const float MEDIUMP_MAX = 1024.0f;
+
+bool isFloatType(pbr::UniformType type)
+{
+    switch (type) {
+    case pbr::UniformType::FLOAT:
+    case pbr::UniformType::FLOAT2:
+    case pbr::UniformType::FLOAT3:
+    case pbr::UniformType::FLOAT4:
+    case pbr::UniformType::MAT3:
+    case pbr::UniformType::MAT4:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isMediumRange(const pbr::MaterialBuilder::ValueRange& range)
+{
+    return range.min >= -MEDIUMP_MAX && range.max <= MEDIUMP_MAX;
+}
+
+}
 
 namespace pbr
 {
@@ -27,10 +78,229 @@ namespace pbr
 MaterialBuilder::MaterialBuilder()
 {
     std::fill_n(mProperties, MATERIAL_PROPERTIES_COUNT, false);
+    std::fill_n(mVariablePrecisions, MATERIAL_VARIABLES_COUNT, Precision::DEFAULT);
+}
+
+MaterialBuilder& MaterialBuilder::SetName(const std::string& name) noexcept
+{
+    mMaterialName = name;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetMaterial(const std::string& code, size_t lineOffset) noexcept
+{
+    mMaterialCode = code;
+    mMaterialLineOffset = lineOffset;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetMaterialVertex(const std::string& code, size_t lineOffset) noexcept
+{
+    mMaterialVertexCode = code;
+    mMaterialVertexLineOffset = lineOffset;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetProperty(Property property, bool set) noexcept
+{
+    mProperties[size_t(property)] = set;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetPropertyInference(bool infer) noexcept
+{
+    mInferProperties = infer;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetAttributeInference(bool infer) noexcept
+{
+    mInferAttributes = infer;
+    return *this;
+}
+
+bool MaterialBuilder::AddParameter(UniformType type, size_t size,
+                                   const std::string& name) noexcept
+{
+    if (mParameterCount >= MAX_PARAMETERS_COUNT) {
+        std::cerr << "ERROR: Too many parameters, ignoring " << name << std::endl;
+        return false;
+    }
+    mParameters[mParameterCount++] = Parameter(name.c_str(), type, size);
+    return true;
+}
+
+bool MaterialBuilder::AddParameter(SamplerType type, SamplerFormat format,
+                                   SamplerPrecision precision, const std::string& name) noexcept
+{
+    if (mParameterCount >= MAX_PARAMETERS_COUNT) {
+        std::cerr << "ERROR: Too many parameters, ignoring " << name << std::endl;
+        return false;
+    }
+    mParameters[mParameterCount++] = Parameter(name.c_str(), type, format, precision);
+    return true;
+}
+
+MaterialBuilder& MaterialBuilder::SetVariable(Variable variable, const std::string& name) noexcept
+{
+    mVariables[size_t(variable)] = name;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetUniformPacking(bool pack) noexcept
+{
+    mPackUniforms = pack;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetSamplerArrays(bool arrays) noexcept
+{
+    mSamplerArrays = arrays;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetParameterRange(const std::string& name, float min,
+                                                    float max) noexcept
+{
+    for (size_t i = 0, c = mParameterCount; i < c; i++) {
+        Parameter& param = mParameters[i];
+        if (param.name == name) {
+            if (param.isSampler || !isFloatType(param.uniformType)) {
+                std::cerr << "ERROR: Parameter " << name << " isn't a float, ignoring its range"
+                          << std::endl;
+                return *this;
+            }
+            param.range.min = min;
+            param.range.max = max;
+            param.range.set = true;
+            return *this;
+        }
+    }
+    std::cerr << "ERROR: Unknown parameter " << name << ", ignoring its range" << std::endl;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetVariableRange(Variable variable, float min,
+                                                   float max) noexcept
+{
+    ValueRange& range = mVariableRanges[size_t(variable)];
+    range.min = min;
+    range.max = max;
+    range.set = true;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetPrecisionLowering(bool lower) noexcept
+{
+    mLowerPrecision = lower;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::Require(VertexAttribute attribute) noexcept
+{
+    mRequiredAttributes.set(size_t(attribute));
+    mExplicitAttributes.set(size_t(attribute));
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetShading(Shading shading) noexcept
+{
+    mShading = shading;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetInterpolation(Interpolation interpolation) noexcept
+{
+    mInterpolation = interpolation;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetVertexDomain(VertexDomain domain) noexcept
+{
+    mVertexDomain = domain;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetBlending(BlendingMode blending) noexcept
+{
+    mBlendingMode = blending;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetPostLightingBlending(BlendingMode blending) noexcept
+{
+    mPostLightingBlendingMode = blending;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetDoubleSided(bool doubleSided) noexcept
+{
+    mDoubleSided = doubleSided;
+    mDoubleSidedCapability = true;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetShadowMultiplier(bool shadowMultiplier) noexcept
+{
+    mShadowMultiplier = shadowMultiplier;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetSpecularAntiAliasing(bool specularAntiAliasing) noexcept
+{
+    mSpecularAntiAliasing = specularAntiAliasing;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetClearCoatIorChange(bool clearCoatIorChange) noexcept
+{
+    mClearCoatIorChange = clearCoatIorChange;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetFlipUV(bool flipUV) noexcept
+{
+    mFlipUV = flipUV;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetMultiBounceAmbientOcclusion(bool multiBounceAO) noexcept
+{
+    mMultiBounceAO = multiBounceAO;
+    mMultiBounceAOSet = true;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::SetSpecularAmbientOcclusion(bool specularAO) noexcept
+{
+    mSpecularAO = specularAO;
+    mSpecularAOSet = true;
+    return *this;
+}
+
+void MaterialBuilder::GetMaterialInfo(MaterialInfo& info) noexcept
+{
+    PrepareToBuild(info);
+
+    // the global offsets only depend on the number of material samplers
+    const size_t samplerCount = info.sib.getSize();
+    if (samplerCount != mSamplerBindingsCount) {
+        mSamplerBindings = SamplerBindingMap();
+        mSamplerBindings.populate(&info.sib, mMaterialName.c_str());
+        mSamplerBindingsCount = samplerCount;
+    }
+    info.samplerBindings = mSamplerBindings;
 }
 
 bool MaterialBuilder::RunSemanticAnalysis() noexcept
 {
+    if ((mInferProperties || mInferAttributes) && !AnalyzeMaterialCode()) {
+        return false;
+    }
+    if (mLowerPrecision && !LowerPrecision()) {
+        return false;
+    }
+
     GLSLTools glslTools;
 
     CodeGenParams params{ ShaderModel::GL_ES_30, TargetApi::OPENGL, TargetLanguage::GLSL };
@@ -47,6 +317,283 @@ bool MaterialBuilder::RunSemanticAnalysis() noexcept
     return result;
 }
 
+bool MaterialBuilder::Build(ThreadPool& pool, const std::vector<CodeGenParams>& params,
+                            ShaderOutputList& output) noexcept
+{
+    PBR_TRACE_SCOPE("MaterialBuilder::Build", mMaterialName.c_str());
+
+    if ((mInferProperties || mInferAttributes) && !AnalyzeMaterialCode()) {
+        return false;
+    }
+    if (mLowerPrecision && !LowerPrecision()) {
+        return false;
+    }
+
+    for (auto const& p : params) {
+        // SPIR-V is compiled from a desktop GLSL parse, there is no OpenGL ES flavor of it
+        if (p.targetLanguage == TargetLanguage::SPIRV && p.targetApi == TargetApi::OPENGL &&
+                p.shaderModel == ShaderModel::GL_ES_30) {
+            std::cerr << "ERROR: SPIR-V for OpenGL needs the GL_CORE_41 shader model" << std::endl;
+            return false;
+        }
+    }
+
+    MaterialInfo info;
+    GetMaterialInfo(info);
+
+    // A variant is only generated when the filters map it onto itself, every other key reuses
+    // the program of its filtered key at runtime.
+    output.clear();
+    const bool litVariants = isLit() || mShadowMultiplier;
+    for (auto const& p : params) {
+        for (uint8_t k = 0; k < VARIANT_COUNT; k++) {
+            if (Variant::isReserved(k)) {
+                continue;
+            }
+            uint8_t key = Variant::filterVariant(k, litVariants);
+            if (Variant::filterVariantVertex(key) == k) {
+                output.push_back({ p.shaderModel, p.targetApi, p.targetLanguage,
+                        p.optimization, p.minification, ShaderType::VERTEX, k, std::string(), {},
+                        0, 0 });
+            }
+            if (Variant::filterVariantFragment(key) == k) {
+                output.push_back({ p.shaderModel, p.targetApi, p.targetLanguage,
+                        p.optimization, p.minification, ShaderType::FRAGMENT, k, std::string(), {},
+                        0, 0 });
+            }
+        }
+    }
+
+    // the instruction counts of an optimized SPIR-V program are cached next to it
+    auto getCountsKey = [](uint64_t key) {
+        return hash::Hasher().Add(key).Add("instructions").Get();
+    };
+
+    std::vector<uint64_t> keys(output.size(), 0);
+    std::vector<uint8_t> cached(output.size(), 0);
+    pool.ParallelFor(output.size(), [&](size_t i) {
+        ShaderOutput& out = output[i];
+        PBR_TRACE_SCOPE(out.type == ShaderType::VERTEX ? "generate vertex" : "generate fragment",
+                mMaterialName.c_str(), out.variantKey);
+
+        ShaderGenerator sg(mProperties, mVariables,
+                mMaterialCode, mMaterialLineOffset, mMaterialVertexCode, mMaterialVertexLineOffset);
+
+        if (mShaderCache) {
+            keys[i] = sg.getProgramKey(out.type, out.shaderModel, out.targetApi, out.targetLanguage,
+                    info, out.variantKey, mInterpolation, mVertexDomain);
+            if (out.targetLanguage == TargetLanguage::SPIRV) {
+                if (out.optimization != Optimization::NONE) {
+                    keys[i] = hash::Hasher().Add(keys[i]).Add(out.optimization).Get();
+                }
+                // SPIR-V programs are cached as their binary
+                std::string blob;
+                if (mShaderCache->Get(keys[i], blob) && blob.size() % sizeof(uint32_t) == 0) {
+                    out.spirv.resize(blob.size() / sizeof(uint32_t));
+                    memcpy(out.spirv.data(), blob.data(), blob.size());
+                    uint64_t counts[2];
+                    if (out.optimization != Optimization::NONE &&
+                            mShaderCache->Get(getCountsKey(keys[i]), blob) &&
+                            blob.size() == sizeof(counts)) {
+                        memcpy(counts, blob.data(), sizeof(counts));
+                        out.instructionsBefore = size_t(counts[0]);
+                        out.instructionsAfter = size_t(counts[1]);
+                    }
+                    cached[i] = 1;
+                    return;
+                }
+            } else {
+                if (out.minification != Minification::NONE) {
+                    keys[i] = hash::Hasher().Add(keys[i]).Add(out.minification).Get();
+                }
+                if (mShaderCache->Get(keys[i], out.shader)) {
+                    cached[i] = 1;
+                    return;
+                }
+            }
+        }
+
+        if (out.type == ShaderType::VERTEX) {
+            out.shader = sg.createVertexProgram(out.shaderModel, out.targetApi,
+                    out.targetLanguage, info, out.variantKey, mInterpolation, mVertexDomain);
+        } else {
+            out.shader = sg.createFragmentProgram(out.shaderModel, out.targetApi,
+                    out.targetLanguage, info, out.variantKey, mInterpolation);
+        }
+    });
+
+    // Programs identical to the one of a lower variant key, for the same params and stage, are
+    // aliased to it instead of being validated, compiled and stored again. The filters above
+    // don't catch them all, e.g. vertex programs that ignore dynamic lighting, but such programs
+    // only differ by defines: generated programs are compared once preprocessed. Cached programs
+    // are compared as they are, so they only alias other cached programs.
+    GLSLTools glslTools;
+    std::vector<std::string> contents(output.size());
+    pool.ParallelFor(output.size(), [&](size_t i) {
+        auto const& out = output[i];
+        if (!cached[i]) {
+            // a program that fails here fails its validation, it is then left unaliased
+            glslTools.Preprocess(out.shader, out.type, out.shaderModel, out.targetApi,
+                    contents[i]);
+        } else if (out.targetLanguage == TargetLanguage::SPIRV) {
+            contents[i].assign(reinterpret_cast<const char*>(out.spirv.data()),
+                    out.spirv.size() * sizeof(uint32_t));
+        } else {
+            contents[i] = out.shader;
+        }
+    });
+
+    std::vector<size_t> aliases(output.size(), SIZE_MAX);
+    std::unordered_multimap<uint64_t, size_t> programs;
+    for (size_t i = 0; i < output.size(); i++) {
+        auto& out = output[i];
+        if (contents[i].empty()) {
+            continue;
+        }
+        const uint64_t hash = hash::Hasher().Add(out.shaderModel).Add(out.targetApi)
+                .Add(out.targetLanguage).Add(out.optimization).Add(out.minification)
+                .Add(out.type).Add(cached[i]).Add(contents[i]).Get();
+        auto range = programs.equal_range(hash);
+        for (auto itr = range.first; itr != range.second; ++itr) {
+            const size_t j = itr->second;
+            auto const& other = output[j];
+            if (other.shaderModel == out.shaderModel && other.targetApi == out.targetApi &&
+                    other.targetLanguage == out.targetLanguage &&
+                    other.optimization == out.optimization &&
+                    other.minification == out.minification && other.type == out.type &&
+                    cached[j] == cached[i] && contents[j] == contents[i]) {
+                aliases[i] = j;
+                break;
+            }
+        }
+        if (aliases[i] == SIZE_MAX) {
+            programs.emplace(hash, i);
+        } else {
+            out.aliasOf = output[aliases[i]].variantKey;
+            out.shader.clear();
+            out.spirv.clear();
+        }
+    }
+    contents.clear();
+
+    // Variant 0 always contains the material code, it gets the full semantic analysis. The
+    // other variants only need to compile.
+    std::vector<GLSLTools::ShaderSource> sources;
+    std::vector<size_t> indices;
+    std::vector<GLSLMinifier::Symbols> symbols(output.size());
+    for (size_t i = 0; i < output.size(); i++) {
+        if (!cached[i] && aliases[i] == SIZE_MAX) {
+            auto& out = output[i];
+            const bool spirv = out.targetLanguage == TargetLanguage::SPIRV;
+            const bool minify = !spirv && out.minification != Minification::NONE;
+            sources.push_back({ out.type, &out.shader, out.shaderModel, out.targetApi,
+                    out.variantKey == 0, spirv ? &out.spirv : nullptr,
+                    minify ? &symbols[i] : nullptr });
+            indices.push_back(i);
+        }
+    }
+
+    std::vector<uint8_t> valid;
+    bool ok = glslTools.ValidateShaders(pool, sources, valid);
+
+    // optimizer messages are printed in order once all are done, as the validation ones
+    std::vector<std::string> logs(indices.size());
+    std::vector<std::string> unminified(indices.size());
+    pool.ParallelFor(indices.size(), [&](size_t i) {
+        ShaderOutput& out = output[indices[i]];
+        if (!valid[i]) {
+            return;
+        }
+        if (out.targetLanguage == TargetLanguage::GLSL) {
+            if (out.minification != Minification::NONE) {
+                PBR_TRACE_SCOPE("GLSLMinifier::Minify", mMaterialName.c_str(), out.variantKey);
+                GLSLMinifier minifier(out.minification == Minification::STRIP_AND_RENAME);
+                unminified[i] = minifier.Minify(out.shader, symbols[indices[i]]);
+                unminified[i].swap(out.shader);
+            }
+            return;
+        }
+        if (out.spirv.empty() || out.optimization == Optimization::NONE) {
+            return;
+        }
+        PBR_TRACE_SCOPE("SpirvOptimizer::Optimize", mMaterialName.c_str(), out.variantKey);
+        out.instructionsBefore = SpirvOptimizer::CountInstructions(out.spirv);
+        std::stringstream err;
+        if (SpirvOptimizer(out.optimization, out.targetApi).Optimize(out.spirv, err)) {
+            out.instructionsAfter = SpirvOptimizer::CountInstructions(out.spirv);
+        } else {
+            // not fatal, the program is still valid as emitted
+            out.instructionsAfter = out.instructionsBefore;
+            logs[i] = err.str();
+        }
+    });
+    for (auto const& log : logs) {
+        std::cerr << log;
+    }
+    std::cerr << std::flush;
+
+    // the minified programs must still compile, a program the minifier broke ships unminified
+    std::vector<GLSLTools::ShaderSource> minified;
+    std::vector<size_t> minifiedIndices;
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (!unminified[i].empty()) {
+            auto const& out = output[indices[i]];
+            minified.push_back({ out.type, &out.shader, out.shaderModel, out.targetApi, false,
+                    nullptr, nullptr });
+            minifiedIndices.push_back(i);
+        }
+    }
+    if (!minified.empty()) {
+        std::vector<uint8_t> minifiedValid;
+        glslTools.ValidateShaders(pool, minified, minifiedValid);
+        for (size_t j = 0; j < minified.size(); j++) {
+            if (!minifiedValid[j]) {
+                const size_t i = minifiedIndices[j];
+                auto& out = output[indices[i]];
+                std::cerr << "ERROR: The minified "
+                          << (out.type == ShaderType::VERTEX ? "vertex" : "fragment")
+                          << " program of variant " << int(out.variantKey)
+                          << " of " << mMaterialName << " doesn't compile, keeping it unminified"
+                          << std::endl;
+                out.shader.swap(unminified[i]);
+            }
+        }
+    }
+
+    if (mShaderCache) {
+        PBR_TRACE_SCOPE("ShaderCache::Put", mMaterialName.c_str());
+        auto put = [&](uint64_t key, const ShaderOutput& out) {
+            if (out.targetLanguage == TargetLanguage::SPIRV) {
+                mShaderCache->Put(key, std::string(
+                        reinterpret_cast<const char*>(out.spirv.data()),
+                        out.spirv.size() * sizeof(uint32_t)));
+                if (out.optimization != Optimization::NONE) {
+                    const uint64_t counts[2] = { out.instructionsBefore, out.instructionsAfter };
+                    mShaderCache->Put(getCountsKey(key),
+                            std::string(reinterpret_cast<const char*>(counts), sizeof(counts)));
+                }
+            } else {
+                mShaderCache->Put(key, out.shader);
+            }
+        };
+        std::vector<uint8_t> validated(output.size(), 0);
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (valid[i]) {
+                validated[indices[i]] = 1;
+                put(keys[indices[i]], output[indices[i]]);
+            }
+        }
+        // aliases are cached as their program, the next build finds and aliases them again
+        for (size_t i = 0; i < output.size(); i++) {
+            if (aliases[i] != SIZE_MAX && !cached[i] && validated[aliases[i]]) {
+                put(keys[i], output[aliases[i]]);
+            }
+        }
+    }
+
+    return ok;
+}
+
 std::string MaterialBuilder::Peek(ShaderType type, const CodeGenParams& params,
                                   const PropertyList& properties) noexcept
 {
@@ -54,11 +601,7 @@ std::string MaterialBuilder::Peek(ShaderType type, const CodeGenParams& params,
             mMaterialCode, mMaterialLineOffset, mMaterialVertexCode, mMaterialVertexLineOffset);
 
     MaterialInfo info;
-    PrepareToBuild(info);
-
-    SamplerBindingMap map;
-    map.populate(&info.sib, mMaterialName.c_str());
-    info.samplerBindings = std::move(map);
+    GetMaterialInfo(info);
 
     if (type == ShaderType::VERTEX) {
         return sg.createVertexProgram(ShaderModel(params.shaderModel),
@@ -71,18 +614,179 @@ std::string MaterialBuilder::Peek(ShaderType type, const CodeGenParams& params,
     return std::string("");
 }
 
+bool MaterialBuilder::AnalyzeMaterialCode() noexcept
+{
+    PBR_TRACE_SCOPE("MaterialBuilder::AnalyzeMaterialCode", mMaterialName.c_str());
+
+    // The programs enable everything the analysis may find, so that any use by the material code
+    // compiles and can be traced: every property declares its MaterialInputs field, every
+    // inferred attribute its getters and MaterialVertexInputs field.
+    PropertyList properties;
+    if (mInferProperties) {
+        std::fill_n(properties, MATERIAL_PROPERTIES_COUNT, true);
+    } else {
+        std::copy(std::begin(mProperties), std::end(mProperties), std::begin(properties));
+    }
+    MaterialInfo info;
+    GetMaterialInfo(info);
+    if (mInferAttributes) {
+        info.requiredAttributes |= INFERRED_ATTRIBUTES;
+    }
+
+    const ShaderModel model = ShaderModel::GL_ES_30;
+    ShaderGenerator sg(properties, mVariables,
+            mMaterialCode, mMaterialLineOffset, mMaterialVertexCode, mMaterialVertexLineOffset);
+    const std::string fragment = sg.createFragmentProgram(model, TargetApi::OPENGL,
+            TargetLanguage::GLSL, info, 0, mInterpolation);
+    const std::string vertex = mInferAttributes ? sg.createVertexProgram(model, TargetApi::OPENGL,
+            TargetLanguage::GLSL, info, 0, mInterpolation, mVertexDomain) : std::string();
+
+    // The results only depend on these programs. They are cached as one byte per property,
+    // followed by the attribute bits.
+    const uint64_t key = hash::Hasher().Add("material code").Add(fragment).Add(vertex).Get();
+    const size_t blobSize = MATERIAL_PROPERTIES_COUNT + sizeof(uint32_t);
+    AttributeBitset attributes;
+    std::string blob;
+    if (mShaderCache && mShaderCache->Get(key, blob) && blob.size() == blobSize) {
+        uint32_t bits;
+        memcpy(&bits, blob.data() + MATERIAL_PROPERTIES_COUNT, sizeof(bits));
+        for (size_t i = 0; i < MATERIAL_PROPERTIES_COUNT; i++) {
+            properties[i] = blob[i] != 0;
+        }
+        attributes = AttributeBitset(bits);
+    } else {
+        GLSLTools tools;
+        bool ok = true;
+        if (mInferProperties) {
+            ok = tools.FindProperties(fragment, model, TargetApi::OPENGL, properties,
+                    mInferAttributes ? &attributes : nullptr);
+        } else if (mInferAttributes) {
+            ok = tools.FindAttributes(fragment, ShaderType::FRAGMENT, model, TargetApi::OPENGL,
+                    attributes);
+        }
+        if (ok && mInferAttributes) {
+            ok = tools.FindAttributes(vertex, ShaderType::VERTEX, model, TargetApi::OPENGL,
+                    attributes);
+        }
+        if (!ok) {
+            std::cerr << "ERROR: Unable to analyze the material code of " << mMaterialName
+                      << std::endl;
+            return false;
+        }
+
+        if (mShaderCache) {
+            const uint32_t bits = uint32_t(attributes.to_ulong());
+            blob.assign(std::begin(properties), std::end(properties));
+            blob.append(reinterpret_cast<const char*>(&bits), sizeof(bits));
+            mShaderCache->Put(key, blob);
+        }
+    }
+
+    if (mInferProperties) {
+        std::copy(std::begin(properties), std::end(properties), std::begin(mProperties));
+    }
+    if (mInferAttributes) {
+        // PrepareToBuild() adds POSITION, and TANGENTS for lit materials and shadow multipliers
+        mRequiredAttributes = mExplicitAttributes | attributes;
+    }
+    return true;
+}
+
+bool MaterialBuilder::LowerPrecision() noexcept
+{
+    PBR_TRACE_SCOPE("MaterialBuilder::LowerPrecision", mMaterialName.c_str());
+
+    for (size_t i = 0, c = mParameterCount; i < c; i++) {
+        mParameters[i].precision = Precision::DEFAULT;
+    }
+    std::fill_n(mVariablePrecisions, MATERIAL_VARIABLES_COUNT, Precision::DEFAULT);
+    mPrecisionChanges.clear();
+
+    // Without vertex code materialVertex() is empty
+    std::set<std::string> vertexParameters;
+    if (!mMaterialVertexCode.empty()) {
+        MaterialInfo info;
+        GetMaterialInfo(info);
+        const ShaderModel model = ShaderModel::GL_ES_30;
+        ShaderGenerator sg(mProperties, mVariables,
+                mMaterialCode, mMaterialLineOffset, mMaterialVertexCode, mMaterialVertexLineOffset);
+        const std::string vertex = sg.createVertexProgram(model, TargetApi::OPENGL,
+                TargetLanguage::GLSL, info, 0, mInterpolation, mVertexDomain);
+        GLSLTools tools;
+        if (!tools.FindParameters(vertex, ShaderType::VERTEX, model, TargetApi::OPENGL,
+                vertexParameters)) {
+            std::cerr << "ERROR: Unable to analyze the material code of " << mMaterialName
+                      << std::endl;
+            return false;
+        }
+    }
+
+    for (size_t i = 0, c = mParameterCount; i < c; i++) {
+        Parameter& param = mParameters[i];
+        if (param.isSampler || !isFloatType(param.uniformType)) {
+            continue;
+        }
+        // parameters default to mediump on mobile, they can only be raised
+        const char* reason = nullptr;
+        if (vertexParameters.count(param.name)) {
+            reason = "read by materialVertex()";
+        } else if (param.range.set && !isMediumRange(param.range)) {
+            reason = "range exceeds mediump";
+        }
+        if (reason) {
+            param.precision = Precision::HIGH;
+            mPrecisionChanges.push_back({ param.name, false, Precision::MEDIUM, Precision::HIGH,
+                    reason });
+        }
+    }
+
+    for (size_t i = 0; i < MATERIAL_VARIABLES_COUNT; i++) {
+        const ValueRange& range = mVariableRanges[i];
+        if (!mVariables[i].empty() && range.set && isMediumRange(range)) {
+            mVariablePrecisions[i] = Precision::MEDIUM;
+            mPrecisionChanges.push_back({ mVariables[i], true, Precision::HIGH, Precision::MEDIUM,
+                    "range within mediump" });
+        }
+    }
+    return true;
+}
+
 void MaterialBuilder::PrepareToBuild(MaterialInfo& info) noexcept
 {
+    PBR_TRACE_SCOPE("MaterialBuilder::PrepareToBuild", mMaterialName.c_str());
+
     // Build the per-material sampler block and uniform block.
     SamplerInterfaceBlock::Builder sbb;
     UniformInterfaceBlock::Builder ibb;
+    std::vector<SamplerLayer> layers;
+    if (mSamplerArrays) {
+        GroupSamplers(layers);
+    }
     for (size_t i = 0, c = mParameterCount; i < c; i++) {
         auto const& param = mParameters[i];
         if (param.isSampler) {
-            sbb.add(param.name, param.samplerType, param.samplerFormat, param.samplerPrecision);
+            auto grouped = std::find_if(layers.begin(), layers.end(),
+                    [&](SamplerLayer const& layer) { return layer.sampler == param.name; });
+            if (grouped == layers.end()) {
+                sbb.add(param.name, param.samplerType, param.samplerFormat,
+                        param.samplerPrecision);
+            }
         } else {
-            ibb.add(param.name, param.size, param.uniformType);
+            ibb.add(param.name, param.size, param.uniformType, param.precision);
+        }
+    }
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (i == 0 || layers[i].array != layers[i - 1].array) {
+            // the first sampler of the group gives its format and precision
+            for (size_t j = 0, c = mParameterCount; j < c; j++) {
+                auto const& param = mParameters[j];
+                if (param.name == layers[i].sampler) {
+                    sbb.add(layers[i].array, SamplerType::SAMPLER_2D_ARRAY, param.samplerFormat,
+                            param.samplerPrecision);
+                }
+            }
         }
+        ibb.add(layers[i].layer, 1, UniformType::INT);
     }
 
     if (mSpecularAntiAliasing) {
@@ -104,7 +808,8 @@ void MaterialBuilder::PrepareToBuild(MaterialInfo& info) noexcept
     }
 
     info.sib = sbb.name("MaterialParams").build();
-    info.uib = ibb.name("MaterialParams").build();
+    info.samplerLayers = std::move(layers);
+    info.uib = ibb.name("MaterialParams").packing(mPackUniforms).build();
 
     info.isLit = isLit();
     info.hasDoubleSidedCapability = mDoubleSidedCapability;
@@ -121,6 +826,50 @@ void MaterialBuilder::PrepareToBuild(MaterialInfo& info) noexcept
     info.multiBounceAOSet = mMultiBounceAOSet;
     info.specularAO = mSpecularAO;
     info.specularAOSet = mSpecularAOSet;
+    std::copy(std::begin(mVariablePrecisions), std::end(mVariablePrecisions),
+            std::begin(info.variablePrecisions));
+}
+
+void MaterialBuilder::GroupSamplers(std::vector<SamplerLayer>& layers) const noexcept
+{
+    std::vector<const Parameter*> candidates;
+    for (size_t i = 0, c = mParameterCount; i < c; i++) {
+        auto const& param = mParameters[i];
+        if (!param.isSampler || param.samplerType != SamplerType::SAMPLER_2D ||
+                param.samplerFormat == SamplerFormat::SHADOW) {
+            continue;
+        }
+        const std::string name = SamplerInterfaceBlock::getUniformName("MaterialParams",
+                param.name.c_str());
+        if (SamplerLayers::CanRewrite(mMaterialCode, name) &&
+                SamplerLayers::CanRewrite(mMaterialVertexCode, name)) {
+            candidates.push_back(&param);
+        }
+    }
+
+    // one array per format and precision, for two samplers or more
+    size_t arrayCount = 0;
+    std::vector<bool> grouped(candidates.size(), false);
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (grouped[i]) {
+            continue;
+        }
+        std::vector<size_t> group = { i };
+        for (size_t j = i + 1; j < candidates.size(); j++) {
+            if (!grouped[j] && candidates[j]->samplerFormat == candidates[i]->samplerFormat &&
+                    candidates[j]->samplerPrecision == candidates[i]->samplerPrecision) {
+                group.push_back(j);
+            }
+        }
+        if (group.size() < 2) {
+            continue;
+        }
+        const std::string array = "_layers" + std::to_string(arrayCount++);
+        for (size_t k : group) {
+            grouped[k] = true;
+            layers.push_back({ candidates[k]->name, array, "_" + candidates[k]->name + "Layer" });
+        }
+    }
 }
 
 bool MaterialBuilder::hasExternalSampler() const noexcept
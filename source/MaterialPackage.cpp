@@ -0,0 +1,661 @@
+#include "pbr/MaterialPackage.h"
+#include "pbr/Hash.h"
+#include "pbr/Lz.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+size_t align8(size_t offset)
+{
+    return (offset + 7) & ~size_t(7);
+}
+
+bool inBounds(size_t offset, size_t count, size_t elementSize, size_t size)
+{
+    return offset <= size && count <= (size - offset) / elementSize;
+}
+
+}
+
+namespace pbr
+{
+
+//////////////////////////////////////////////////////////////////////////
+// class MaterialPackage
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t MaterialPackage::MakeKey(ShaderModel shaderModel, MaterialBuilder::TargetApi targetApi,
+                                  MaterialBuilder::TargetLanguage targetLanguage, ShaderType type,
+                                  uint8_t variant) noexcept
+{
+    return (uint32_t(shaderModel) << 24) | (uint32_t(targetApi) << 16) |
+           (uint32_t(targetLanguage) << 12) | (uint32_t(type) << 8) | variant;
+}
+
+MaterialPackage::~MaterialPackage()
+{
+    Close();
+}
+
+bool MaterialPackage::Open(const std::string& filepath) noexcept
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "ERROR: Unable to open " << filepath << std::endl;
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = nullptr;
+    const void* data = nullptr;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+    }
+    if (!data) {
+        std::cerr << "ERROR: Unable to map " << filepath << std::endl;
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    mFile = file;
+    mMapping = mapping;
+    mView = data;
+    mViewSize = size_t(size.QuadPart);
+#else
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "ERROR: Unable to open " << filepath << std::endl;
+        return false;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // the mapping stays valid once the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "ERROR: Unable to map " << filepath << std::endl;
+        return false;
+    }
+    mView = data;
+    mViewSize = size_t(st.st_size);
+#endif
+
+    if (!Use(mView, mViewSize)) {
+        std::cerr << "ERROR: Invalid material package " << filepath << std::endl;
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool MaterialPackage::Open(const void* data, size_t size) noexcept
+{
+    Close();
+    return Use(data, size);
+}
+
+bool MaterialPackage::Use(const void* data, size_t size) noexcept
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (!bytes || (reinterpret_cast<uintptr_t>(bytes) & 7) != 0 || size < sizeof(Header)) {
+        return false;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(bytes);
+    if (header->magic != MAGIC || header->version != VERSION || header->size > size) {
+        return false;
+    }
+    size = header->size;
+    if (!inBounds(header->uniformsOffset, header->uniformCount, sizeof(Uniform), size) ||
+        !inBounds(header->samplersOffset, header->samplerCount, sizeof(Sampler), size) ||
+        !inBounds(header->samplerBindingsOffset, header->samplerBindingCount,
+                  sizeof(SamplerBinding), size) ||
+        !inBounds(header->shadersOffset, header->shaderCount, sizeof(Shader), size) ||
+        !inBounds(header->blobsOffset, header->blobCount, sizeof(Blob), size) ||
+        !inBounds(header->stringsOffset, header->stringsSize, 1, size)) {
+        return false;
+    }
+    // every string lookup stops at the end of the table
+    if (header->stringsSize > 0 && bytes[header->stringsOffset + header->stringsSize - 1] != 0) {
+        return false;
+    }
+    if (header->lineCount > 0) {
+        if (!inBounds(header->lineOffsetsOffset, size_t(header->lineCount) + 1, sizeof(uint32_t), size) ||
+            !inBounds(header->lineDataOffset, header->lineDataSize, 1, size)) {
+            return false;
+        }
+        // checked once here so that decoding only has to check the indices
+        auto offsets = reinterpret_cast<const uint32_t*>(bytes + header->lineOffsetsOffset);
+        for (uint32_t i = 0; i < header->lineCount; i++) {
+            if (offsets[i] > offsets[i + 1]) {
+                return false;
+            }
+        }
+        if (offsets[header->lineCount] > header->lineDataSize) {
+            return false;
+        }
+    }
+
+    mData = bytes;
+    mSize = size;
+    mHeader = header;
+    return true;
+}
+
+void MaterialPackage::Close() noexcept
+{
+#ifdef _WIN32
+    if (mView) {
+        UnmapViewOfFile(mView);
+    }
+    if (mMapping) {
+        CloseHandle(mMapping);
+    }
+    if (mFile) {
+        CloseHandle(mFile);
+    }
+#else
+    if (mView) {
+        munmap(const_cast<void*>(mView), mViewSize);
+    }
+#endif
+    mData = nullptr;
+    mSize = 0;
+    mHeader = nullptr;
+    mView = nullptr;
+    mViewSize = 0;
+    mMapping = nullptr;
+    mFile = nullptr;
+}
+
+const char* MaterialPackage::GetName() const noexcept
+{
+    return mHeader ? GetString(mHeader->nameOffset) : "";
+}
+
+bool MaterialPackage::GetMaterialInfo(MaterialInfo& info) const noexcept
+{
+    if (!mHeader) {
+        return false;
+    }
+    const Header& h = *mHeader;
+
+    info.isLit                    = h.isLit != 0;
+    info.hasDoubleSidedCapability = h.hasDoubleSidedCapability != 0;
+    info.hasExternalSamplers      = h.hasExternalSamplers != 0;
+    info.hasShadowMultiplier      = h.hasShadowMultiplier != 0;
+    info.specularAntiAliasing     = h.specularAntiAliasing != 0;
+    info.clearCoatIorChange       = h.clearCoatIorChange != 0;
+    info.flipUV                   = h.flipUV != 0;
+    info.multiBounceAO            = h.multiBounceAO != 0;
+    info.multiBounceAOSet         = h.multiBounceAOSet != 0;
+    info.specularAO               = h.specularAO != 0;
+    info.specularAOSet            = h.specularAOSet != 0;
+    info.requiredAttributes       = AttributeBitset(h.requiredAttributes);
+    info.blendingMode             = BlendingMode(h.blendingMode);
+    info.postLightingBlendingMode = BlendingMode(h.postLightingBlendingMode);
+    info.shading                  = Shading(h.shading);
+
+    // the builders lay the blocks out exactly as they were when the package was written
+    UniformInterfaceBlock::Builder ibb;
+    ibb.name(GetString(h.uibNameOffset));
+    auto uniforms = reinterpret_cast<const Uniform*>(mData + h.uniformsOffset);
+    for (uint32_t i = 0; i < h.uniformCount; i++) {
+        auto const& u = uniforms[i];
+        ibb.add(GetString(u.nameOffset), u.size, UniformType(u.type), Precision(u.precision));
+    }
+    info.uib = ibb.build();
+
+    SamplerInterfaceBlock::Builder sbb;
+    sbb.name(GetString(h.sibNameOffset));
+    auto samplers = reinterpret_cast<const Sampler*>(mData + h.samplersOffset);
+    for (uint32_t i = 0; i < h.samplerCount; i++) {
+        auto const& s = samplers[i];
+        sbb.add(GetString(s.nameOffset), SamplerType(s.type), SamplerFormat(s.format),
+                Precision(s.precision), s.multisample != 0);
+    }
+    info.sib = sbb.build();
+
+    info.samplerBindings = SamplerBindingMap();
+    auto bindings = reinterpret_cast<const SamplerBinding*>(mData + h.samplerBindingsOffset);
+    for (uint32_t i = 0; i < h.samplerBindingCount; i++) {
+        auto const& b = bindings[i];
+        info.samplerBindings.addSampler({ b.blockIndex, b.localOffset, b.globalOffset });
+    }
+
+    return true;
+}
+
+bool MaterialPackage::GetShader(uint32_t key, const void*& data, size_t& size) const noexcept
+{
+    const Blob* blob = FindBlob(key);
+    if (!blob || blob->encoding != Encoding::RAW) {
+        return false;
+    }
+    data = mData + blob->offset;
+    size = blob->size;
+    return true;
+}
+
+bool MaterialPackage::GetShader(uint32_t key, std::string& blob) const noexcept
+{
+    const Blob* b = FindBlob(key);
+    if (!b) {
+        return false;
+    }
+    switch (b->encoding)
+    {
+    case Encoding::RAW:
+        blob.assign(reinterpret_cast<const char*>(mData + b->offset), b->size);
+        return true;
+    case Encoding::LZ:
+        blob.resize(b->rawSize);
+        return b->rawSize == 0 || lz::Decompress(mData + b->offset, b->size, &blob[0], blob.size());
+    case Encoding::LINES:
+        return DecodeLines(*b, blob);
+    default:
+        return false;
+    }
+}
+
+const MaterialPackage::Blob* MaterialPackage::FindBlob(uint32_t key) const noexcept
+{
+    if (!mHeader) {
+        return nullptr;
+    }
+
+    auto begin = reinterpret_cast<const Shader*>(mData + mHeader->shadersOffset);
+    auto end = begin + mHeader->shaderCount;
+    auto itr = std::lower_bound(begin, end, key, [](Shader const& shader, uint32_t key) {
+        return shader.key < key;
+    });
+    if (itr == end || itr->key != key || itr->blobIndex >= mHeader->blobCount) {
+        return nullptr;
+    }
+
+    auto blob = reinterpret_cast<const Blob*>(mData + mHeader->blobsOffset) + itr->blobIndex;
+    if (!inBounds(blob->offset, blob->size, 1, mSize)) {
+        return nullptr;
+    }
+    // the decoded size is trusted by the accessors
+    if (blob->rawSize > MAX_BLOB_SIZE ||
+            (blob->encoding == Encoding::RAW && blob->rawSize != blob->size)) {
+        return nullptr;
+    }
+    return blob;
+}
+
+const char* MaterialPackage::GetString(uint32_t offset) const noexcept
+{
+    if (offset >= mHeader->stringsSize) {
+        return "";
+    }
+    return reinterpret_cast<const char*>(mData + mHeader->stringsOffset + offset);
+}
+
+bool MaterialPackage::DecodeLines(const Blob& blob, std::string& text) const noexcept
+{
+    auto offsets = reinterpret_cast<const uint32_t*>(mData + mHeader->lineOffsetsOffset);
+    auto lines = reinterpret_cast<const char*>(mData + mHeader->lineDataOffset);
+
+    // the decoded size is known, so this is one allocation and a memcpy per line
+    text.resize(blob.rawSize);
+    char* dst = &text[0];
+    size_t written = 0;
+
+    const uint8_t* p = mData + blob.offset;
+    const uint8_t* end = p + blob.size;
+    while (p != end)
+    {
+        size_t index;
+        if (!lz::ReadVarint(p, end, index) || index >= mHeader->lineCount) {
+            return false;
+        }
+        const size_t size = offsets[index + 1] - offsets[index];
+        if (size + 1 > blob.rawSize + 1 - written) {
+            return false;
+        }
+        memcpy(dst + written, lines + offsets[index], size);
+        written += size;
+        // the last line has no newline if the text didn't end with one
+        if (written < blob.rawSize) {
+            dst[written++] = '\n';
+        }
+    }
+    return written == blob.rawSize;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// class MaterialPackageWriter
+//////////////////////////////////////////////////////////////////////////
+
+MaterialPackageWriter::MaterialPackageWriter(const std::string& name, const MaterialInfo& info)
+    : mName(name)
+    , mInfo(info)
+{
+}
+
+void MaterialPackageWriter::AddShader(const MaterialBuilder::ShaderOutput& output)
+{
+    const uint32_t key = MaterialPackage::MakeKey(output.shaderModel, output.targetApi,
+            output.targetLanguage, output.type, output.variantKey);
+
+    // an alias shares the blob of its program, which comes first in the build output
+    if (output.aliasOf != MaterialBuilder::NO_ALIAS) {
+        auto itr = mShaders.find(MaterialPackage::MakeKey(output.shaderModel, output.targetApi,
+                output.targetLanguage, output.type, output.aliasOf));
+        if (itr == mShaders.end()) {
+            std::cerr << "ERROR: Variant " << int(output.variantKey) << " is an alias of "
+                      << int(output.aliasOf) << ", which wasn't added" << std::endl;
+            return;
+        }
+        mShaders[key] = itr->second;
+        return;
+    }
+
+    BlobData blob;
+    blob.text = output.targetLanguage != MaterialBuilder::TargetLanguage::SPIRV;
+    if (blob.text) {
+        blob.data = output.shader;
+    } else {
+        blob.data.assign(reinterpret_cast<const char*>(output.spirv.data()),
+                output.spirv.size() * sizeof(uint32_t));
+    }
+
+    const uint64_t hash = hash::fnv1a(blob.data.data(), blob.data.size());
+    auto range = mBlobIndices.equal_range(hash);
+    for (auto itr = range.first; itr != range.second; ++itr) {
+        if (mBlobs[itr->second].text == blob.text && mBlobs[itr->second].data == blob.data) {
+            mShaders[key] = itr->second;
+            return;
+        }
+    }
+
+    const uint32_t index = uint32_t(mBlobs.size());
+    mBlobs.push_back(std::move(blob));
+    mBlobIndices.emplace(hash, index);
+    mShaders[key] = index;
+}
+
+void MaterialPackageWriter::AddShaders(const MaterialBuilder::ShaderOutputList& outputs)
+{
+    for (auto const& output : outputs) {
+        AddShader(output);
+    }
+}
+
+void MaterialPackageWriter::Write(std::vector<uint8_t>& package) const
+{
+    using Package = MaterialPackage;
+
+    std::string strings;
+    auto addString = [&strings](const std::string& str) {
+        uint32_t offset = uint32_t(strings.size());
+        strings.append(str.c_str(), str.size() + 1);
+        return offset;
+    };
+
+    Package::Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic           = Package::MAGIC;
+    header.version         = Package::VERSION;
+    header.materialVersion = uint32_t(MATERIAL_VERSION);
+
+    header.nameOffset               = addString(mName);
+    header.requiredAttributes       = uint32_t(mInfo.requiredAttributes.to_ulong());
+    header.isLit                    = mInfo.isLit;
+    header.hasDoubleSidedCapability = mInfo.hasDoubleSidedCapability;
+    header.hasExternalSamplers      = mInfo.hasExternalSamplers;
+    header.hasShadowMultiplier      = mInfo.hasShadowMultiplier;
+    header.specularAntiAliasing     = mInfo.specularAntiAliasing;
+    header.clearCoatIorChange       = mInfo.clearCoatIorChange;
+    header.flipUV                   = mInfo.flipUV;
+    header.multiBounceAO            = mInfo.multiBounceAO;
+    header.multiBounceAOSet         = mInfo.multiBounceAOSet;
+    header.specularAO               = mInfo.specularAO;
+    header.specularAOSet            = mInfo.specularAOSet;
+    header.blendingMode             = uint8_t(mInfo.blendingMode);
+    header.postLightingBlendingMode = uint8_t(mInfo.postLightingBlendingMode);
+    header.shading                  = uint8_t(mInfo.shading);
+
+    std::vector<Package::Uniform> uniforms;
+    header.uibNameOffset = addString(mInfo.uib.getName());
+    header.uibSize = uint32_t(mInfo.uib.getSize());
+    for (auto const& info : mInfo.uib.getUniformInfoList()) {
+        Package::Uniform u;
+        memset(&u, 0, sizeof(u));
+        u.nameOffset = addString(info.name);
+        u.size       = info.size;
+        u.offset     = info.offset;
+        u.stride     = info.stride;
+        u.type       = uint8_t(info.type);
+        u.precision  = uint8_t(info.precision);
+        uniforms.push_back(u);
+    }
+
+    std::vector<Package::Sampler> samplers;
+    header.sibNameOffset = addString(mInfo.sib.getName());
+    header.sibSize = uint32_t(mInfo.sib.getSize());
+    for (auto const& info : mInfo.sib.getSamplerInfoList()) {
+        Package::Sampler s;
+        memset(&s, 0, sizeof(s));
+        s.nameOffset  = addString(info.name);
+        s.offset      = info.offset;
+        s.type        = uint8_t(info.type);
+        s.format      = uint8_t(info.format);
+        s.precision   = uint8_t(info.precision);
+        s.multisample = info.multisample;
+        samplers.push_back(s);
+    }
+
+    std::vector<Package::SamplerBinding> bindings;
+    for (auto const& info : mInfo.samplerBindings.getSamplerBindings()) {
+        bindings.push_back({ info.blockIndex, info.localOffset, info.globalOffset, 0 });
+    }
+
+    std::vector<Package::Shader> shaders;
+    for (auto const& shader : mShaders) {
+        shaders.push_back({ shader.first, shader.second });
+    }
+
+    std::vector<std::string> lines;
+    std::vector<uint32_t> lineOffsets;
+    std::string lineData;
+    std::vector<std::vector<uint32_t>> blobLines(mBlobs.size());
+    if (mLineDictionary) {
+        BuildLineDictionary(lines, blobLines);
+        lineOffsets.reserve(lines.size() + 1);
+        for (auto const& line : lines) {
+            lineOffsets.push_back(uint32_t(lineData.size()));
+            lineData += line;
+        }
+        lineOffsets.push_back(uint32_t(lineData.size()));
+    }
+
+    // stored form of each blob: line lists for GLSL, else compressed only where it helps
+    std::vector<std::string> encoded(mBlobs.size());
+    std::vector<Package::Encoding> encodings(mBlobs.size(), Package::Encoding::RAW);
+    for (size_t i = 0; i < mBlobs.size(); i++) {
+        auto const& blob = mBlobs[i];
+        if (mLineDictionary && blob.text) {
+            for (uint32_t index : blobLines[i]) {
+                lz::WriteVarint(encoded[i], index);
+            }
+            encodings[i] = Package::Encoding::LINES;
+            header.flags |= Package::LINE_DICTIONARY;
+        } else if (mCompress) {
+            lz::Compress(blob.data.data(), blob.data.size(), encoded[i]);
+            if (encoded[i].size() < blob.data.size()) {
+                encodings[i] = Package::Encoding::LZ;
+                header.flags |= Package::COMPRESSED;
+            }
+        }
+    }
+    auto stored = [&](size_t i) -> const std::string& {
+        return encodings[i] == Package::Encoding::RAW ? mBlobs[i].data : encoded[i];
+    };
+
+    // layout, each section 8 bytes aligned
+    size_t offset = sizeof(Package::Header);
+    auto place = [&offset](size_t size) {
+        offset = align8(offset);
+        const size_t at = offset;
+        offset += size;
+        return uint32_t(at);
+    };
+    header.uniformCount          = uint32_t(uniforms.size());
+    header.uniformsOffset        = place(uniforms.size() * sizeof(Package::Uniform));
+    header.samplerCount          = uint32_t(samplers.size());
+    header.samplersOffset        = place(samplers.size() * sizeof(Package::Sampler));
+    header.samplerBindingCount   = uint32_t(bindings.size());
+    header.samplerBindingsOffset = place(bindings.size() * sizeof(Package::SamplerBinding));
+    header.shaderCount           = uint32_t(shaders.size());
+    header.shadersOffset         = place(shaders.size() * sizeof(Package::Shader));
+    header.blobCount             = uint32_t(mBlobs.size());
+    header.blobsOffset           = place(mBlobs.size() * sizeof(Package::Blob));
+    header.stringsSize           = uint32_t(strings.size());
+    header.stringsOffset         = place(strings.size());
+    if (!lines.empty()) {
+        header.lineCount         = uint32_t(lines.size());
+        header.lineOffsetsOffset = place(lineOffsets.size() * sizeof(uint32_t));
+        header.lineDataSize      = uint32_t(lineData.size());
+        header.lineDataOffset    = place(lineData.size());
+    }
+
+    std::vector<Package::Blob> blobs(mBlobs.size());
+    for (size_t i = 0; i < mBlobs.size(); i++) {
+        const std::string& data = stored(i);
+        blobs[i].offset   = place(data.size() + 1);  // + the null char
+        blobs[i].size     = uint32_t(data.size());
+        blobs[i].rawSize  = uint32_t(mBlobs[i].data.size());
+        blobs[i].encoding = encodings[i];
+    }
+    header.size = uint32_t(align8(offset));
+
+    package.assign(header.size, 0);
+    uint8_t* dst = package.data();
+    memcpy(dst, &header, sizeof(header));
+    if (!uniforms.empty()) {
+        memcpy(dst + header.uniformsOffset, uniforms.data(), uniforms.size() * sizeof(uniforms[0]));
+    }
+    if (!samplers.empty()) {
+        memcpy(dst + header.samplersOffset, samplers.data(), samplers.size() * sizeof(samplers[0]));
+    }
+    if (!bindings.empty()) {
+        memcpy(dst + header.samplerBindingsOffset, bindings.data(),
+                bindings.size() * sizeof(bindings[0]));
+    }
+    if (!shaders.empty()) {
+        memcpy(dst + header.shadersOffset, shaders.data(), shaders.size() * sizeof(shaders[0]));
+    }
+    if (!blobs.empty()) {
+        memcpy(dst + header.blobsOffset, blobs.data(), blobs.size() * sizeof(blobs[0]));
+    }
+    memcpy(dst + header.stringsOffset, strings.data(), strings.size());
+    if (!lines.empty()) {
+        memcpy(dst + header.lineOffsetsOffset, lineOffsets.data(),
+                lineOffsets.size() * sizeof(uint32_t));
+        memcpy(dst + header.lineDataOffset, lineData.data(), lineData.size());
+    }
+    for (size_t i = 0; i < mBlobs.size(); i++) {
+        const std::string& data = stored(i);
+        memcpy(dst + blobs[i].offset, data.data(), data.size());
+    }
+}
+
+void MaterialPackageWriter::BuildLineDictionary(std::vector<std::string>& lines,
+                                                std::vector<std::vector<uint32_t>>& blobLines) const
+{
+    // split the GLSL blobs on newlines, counting how often each line is used
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<uint32_t> useCounts;
+    for (size_t i = 0; i < mBlobs.size(); i++)
+    {
+        if (!mBlobs[i].text) {
+            continue;
+        }
+        auto const& text = mBlobs[i].data;
+        size_t begin = 0;
+        while (begin < text.size())
+        {
+            size_t end = text.find('\n', begin);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            auto result = ids.emplace(text.substr(begin, end - begin), uint32_t(lines.size()));
+            if (result.second) {
+                lines.push_back(result.first->first);
+                useCounts.push_back(0);
+            }
+            useCounts[result.first->second]++;
+            blobLines[i].push_back(result.first->second);
+            begin = end + 1;
+        }
+    }
+
+    // most used first, so that they get the shortest varints
+    std::vector<uint32_t> order(lines.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&useCounts](uint32_t lhs, uint32_t rhs) {
+        return useCounts[lhs] > useCounts[rhs];
+    });
+
+    std::vector<uint32_t> remap(lines.size());
+    std::vector<std::string> sorted(lines.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        remap[order[i]] = i;
+        sorted[i] = std::move(lines[order[i]]);
+    }
+    lines.swap(sorted);
+    for (auto& indices : blobLines) {
+        for (auto& index : indices) {
+            index = remap[index];
+        }
+    }
+}
+
+bool MaterialPackageWriter::WriteFile(const std::string& filepath) const
+{
+    std::vector<uint8_t> package;
+    Write(package);
+
+    std::ofstream fout(filepath, std::ios::binary | std::ios::trunc);
+    if (!fout) {
+        std::cerr << "ERROR: Unable to write " << filepath << std::endl;
+        return false;
+    }
+    fout.write(reinterpret_cast<const char*>(package.data()), package.size());
+    return bool(fout);
+}
+
+}
@@ -19,6 +19,7 @@
 #include "pbr/EngineEnums.h"
 #include "pbr/SibGenerator.h"
 #include "pbr/SamplerInterfaceBlock.h"
+#include "pbr/Trace.h"
 
 #include <iostream>
 
@@ -27,6 +28,8 @@ namespace pbr
 
 void SamplerBindingMap::populate(const SamplerInterfaceBlock* perMaterialSib,
             const char* materialName) {
+    PBR_TRACE_SCOPE("SamplerBindingMap::populate", materialName);
+
     uint8_t offset = 0;
     size_t maxSamplerIndex = MAX_SAMPLER_COUNT - 1;
     bool overflow = false;
@@ -84,10 +87,29 @@ void SamplerBindingMap::populate(const SamplerInterfaceBlock* perMaterialSib,
 }
 
 void SamplerBindingMap::addSampler(SamplerBindingInfo info) {
+    if (info.blockIndex >= BindingPoints::COUNT || info.localOffset >= MAX_BLOCK_SAMPLERS) {
+        std::cerr << "ERROR: Sampler binding " << int(info.blockIndex) << ":"
+                  << int(info.localOffset) << " out of range, ignoring it" << std::endl;
+        return;
+    }
     if (info.globalOffset < mSamplerBlockOffsets[info.blockIndex]) {
         mSamplerBlockOffsets[info.blockIndex] = info.globalOffset;
     }
-    mBindingMap[getBindingKey(info.blockIndex, info.localOffset)] = info;
+    mGlobalOffsets[info.blockIndex][info.localOffset] = info.globalOffset;
+}
+
+std::vector<SamplerBindingInfo> SamplerBindingMap::getSamplerBindings() const {
+    // the table is already in block, then offset order
+    std::vector<SamplerBindingInfo> bindings;
+    for (uint8_t blockIndex = 0; blockIndex < BindingPoints::COUNT; blockIndex++) {
+        for (uint8_t localOffset = 0; localOffset < MAX_BLOCK_SAMPLERS; localOffset++) {
+            const uint8_t globalOffset = mGlobalOffsets[blockIndex][localOffset];
+            if (globalOffset != UNKNOWN_OFFSET) {
+                bindings.push_back({ blockIndex, localOffset, globalOffset });
+            }
+        }
+    }
+    return bindings;
 }
 
 }
\ No newline at end of file
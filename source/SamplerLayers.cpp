@@ -0,0 +1,182 @@
+#include "pbr/SamplerLayers.h"
+
+#include <string.h>
+
+namespace
+{
+
+enum class CallKind {
+    SAMPLE,     // coordinates P become vec3(P, layer)
+    FETCH,      // texel coordinates P become ivec3(P, layer)
+    SIZE        // the size of the array is a ivec3, keep xy
+};
+
+struct TextureFunction {
+    const char* name;
+    CallKind kind;
+};
+
+const TextureFunction TEXTURE_FUNCTIONS[] = {
+    { "texture",           CallKind::SAMPLE },
+    { "textureLod",        CallKind::SAMPLE },
+    { "textureGrad",       CallKind::SAMPLE },
+    { "textureOffset",     CallKind::SAMPLE },
+    { "textureLodOffset",  CallKind::SAMPLE },
+    { "textureGradOffset", CallKind::SAMPLE },
+    { "texelFetch",        CallKind::FETCH },
+    { "texelFetchOffset",  CallKind::FETCH },
+    { "textureSize",       CallKind::SIZE },
+};
+
+// A sampler passed as first argument of a texture function.
+struct SamplerUse {
+    size_t begin = std::string::npos;   // of the sampler name
+    size_t end = std::string::npos;
+    CallKind kind = CallKind::SAMPLE;
+    size_t argBegin = 0;    // of the second argument: coordinates, or the lod of textureSize
+    size_t argEnd = 0;      // at the ',' or ')' after it
+};
+
+bool isIdentifierChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Position of the next occurrence of name as a whole identifier, at or after from.
+size_t findIdentifier(const std::string& code, const std::string& name, size_t from)
+{
+    for (size_t i = code.find(name, from); i != std::string::npos; i = code.find(name, i + 1)) {
+        const size_t end = i + name.size();
+        if ((i == 0 || !isIdentifierChar(code[i - 1])) &&
+            (end == code.size() || !isIdentifierChar(code[end]))) {
+            return i;
+        }
+    }
+    return std::string::npos;
+}
+
+// Fills use for the sampler name at begin, returns false if it isn't the first argument of one
+// of the TEXTURE_FUNCTIONS.
+bool parseUse(const std::string& code, size_t begin, size_t length, SamplerUse& use)
+{
+    size_t i = begin;
+    while (i > 0 && isSpace(code[i - 1])) {
+        i--;
+    }
+    if (i == 0 || code[i - 1] != '(') {
+        return false;
+    }
+    i--;
+    while (i > 0 && isSpace(code[i - 1])) {
+        i--;
+    }
+    size_t nameBegin = i;
+    while (nameBegin > 0 && isIdentifierChar(code[nameBegin - 1])) {
+        nameBegin--;
+    }
+    const std::string function = code.substr(nameBegin, i - nameBegin);
+    const TextureFunction* match = nullptr;
+    for (auto const& f : TEXTURE_FUNCTIONS) {
+        if (function == f.name) {
+            match = &f;
+        }
+    }
+    if (!match) {
+        return false;
+    }
+
+    size_t j = begin + length;
+    while (j < code.size() && isSpace(code[j])) {
+        j++;
+    }
+    if (j == code.size() || code[j] != ',') {
+        return false;
+    }
+
+    // the argument ends at the first ',' or ')' outside of parentheses and brackets
+    const size_t argBegin = j + 1;
+    int depth = 0;
+    for (j = argBegin; j < code.size(); j++) {
+        const char c = code[j];
+        if (c == '(' || c == '[') {
+            depth++;
+        } else if ((c == ')' || c == ']') && depth > 0) {
+            depth--;
+        } else if ((c == ',' || c == ')') && depth == 0) {
+            break;
+        }
+    }
+    if (j == code.size() || (match->kind == CallKind::SIZE && code[j] != ')')) {
+        return false;
+    }
+
+    use = { begin, begin + length, match->kind, argBegin, j };
+    return true;
+}
+
+}
+
+namespace pbr
+{
+
+bool SamplerLayers::CanRewrite(const std::string& code, const std::string& sampler) noexcept
+{
+    SamplerUse use;
+    for (size_t i = findIdentifier(code, sampler, 0); i != std::string::npos;
+            i = findIdentifier(code, sampler, i + 1)) {
+        if (!parseUse(code, i, sampler.size(), use)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string SamplerLayers::Rewrite(const std::string& code,
+                                   const std::vector<Names>& layers) noexcept
+{
+    // the first use of any of the samplers, none yet
+    SamplerUse use;
+    const Names* names = nullptr;
+    for (auto const& layer : layers) {
+        const size_t i = findIdentifier(code, layer.sampler, 0);
+        SamplerUse candidate;
+        if (i < use.begin && parseUse(code, i, layer.sampler.size(), candidate)) {
+            use = candidate;
+            names = &layer;
+        }
+    }
+    if (!names) {
+        return code;
+    }
+
+    // the whitespace before the argument stays in front of it
+    size_t argBegin = use.argBegin;
+    while (argBegin < use.argEnd && isSpace(code[argBegin])) {
+        argBegin++;
+    }
+    // the argument may itself sample a grouped sampler
+    const std::string arg = Rewrite(code.substr(argBegin, use.argEnd - argBegin), layers);
+    std::string out = code.substr(0, use.begin);
+    out += names->array;
+    out += code.substr(use.end, argBegin - use.end);
+    switch (use.kind) {
+        case CallKind::SAMPLE:
+            out += "vec3(" + arg + ", float(" + names->layer + "))";
+            break;
+        case CallKind::FETCH:
+            out += "ivec3(" + arg + ", " + names->layer + ")";
+            break;
+        case CallKind::SIZE:
+            out += arg + ").xy";
+            use.argEnd++;
+            break;
+    }
+    return out + Rewrite(code.substr(use.argEnd), layers);
+}
+
+}
@@ -0,0 +1,96 @@
+#include "pbr/ShaderCache.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <stdio.h>
+
+namespace pbr
+{
+
+ShaderCache::ShaderCache(const std::string& directory)
+    : mDirectory(directory)
+    , mHits(0)
+    , mMisses(0)
+{
+    if (!mDirectory.empty() && mDirectory.back() != '/' && mDirectory.back() != '\\') {
+        mDirectory += '/';
+    }
+}
+
+bool ShaderCache::Get(uint64_t key, std::string& blob)
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto itr = mEntries.find(key);
+        if (itr != mEntries.end()) {
+            blob = itr->second;
+            ++mHits;
+            return true;
+        }
+    }
+
+    if (!mDirectory.empty())
+    {
+        std::ifstream fin(GetFilePath(key), std::ios::binary);
+        if (fin) {
+            std::stringstream ss;
+            ss << fin.rdbuf();
+            blob = ss.str();
+
+            std::lock_guard<std::mutex> lock(mLock);
+            mEntries.emplace(key, blob);
+            ++mHits;
+            return true;
+        }
+    }
+
+    ++mMisses;
+    return false;
+}
+
+void ShaderCache::Put(uint64_t key, const std::string& blob)
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEntries[key] = blob;
+    }
+
+    if (!mDirectory.empty())
+    {
+        // write to a per-thread temporary first, so that concurrent builds sharing the directory
+        // never observe a partially written entry.
+        std::string path = GetFilePath(key);
+        std::stringstream tmp;
+        tmp << path << "." << std::this_thread::get_id() << ".tmp";
+        {
+            std::ofstream fout(tmp.str(), std::ios::binary | std::ios::trunc);
+            if (!fout) {
+                return;
+            }
+            fout.write(blob.data(), blob.size());
+        }
+        remove(path.c_str());
+        if (rename(tmp.str().c_str(), path.c_str()) != 0) {
+            remove(tmp.str().c_str());
+        }
+    }
+}
+
+void ShaderCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mEntries.clear();
+    mHits = 0;
+    mMisses = 0;
+}
+
+std::string ShaderCache::GetFilePath(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.shader", (unsigned long long)key);
+    return mDirectory + name;
+}
+
+}
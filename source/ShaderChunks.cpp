@@ -0,0 +1,110 @@
+#include "pbr/ShaderChunks.h"
+#include "pbr/Hash.h"
+
+#include "shaders/ambient_occlusion.fs"
+#include "shaders/brdf.fs"
+#include "shaders/common_getters.fs"
+#include "shaders/common_graphics.fs"
+#include "shaders/common_lighting.fs"
+#include "shaders/common_material.fs"
+#include "shaders/common_math.fs"
+#include "shaders/common_shading.fs"
+#include "shaders/common_types.fs"
+#include "shaders/depth_main.fs"
+#include "shaders/depth_main.vs"
+#include "shaders/getters.fs"
+#include "shaders/getters.vs"
+#include "shaders/inputs.fs"
+#include "shaders/inputs.vs"
+#include "shaders/light_directional.fs"
+#include "shaders/light_indirect.fs"
+#include "shaders/light_punctual.fs"
+#include "shaders/main.fs"
+#include "shaders/main.vs"
+#include "shaders/material_inputs.fs"
+#include "shaders/material_inputs.vs"
+#include "shaders/shading_lit.fs"
+#include "shaders/shading_model_cloth.fs"
+#include "shaders/shading_model_standard.fs"
+#include "shaders/shading_model_subsurface.fs"
+#include "shaders/shading_parameters.fs"
+#include "shaders/shading_unlit.fs"
+#include "shaders/shadowing.fs"
+#include "shaders/shadowing.vs"
+
+namespace
+{
+
+using pbr::ShaderChunk;
+
+constexpr size_t length(const char* str) noexcept
+{
+    size_t n = 0;
+    while (str[n] != '\0') {
+        ++n;
+    }
+    return n;
+}
+
+constexpr size_t countLines(const char* str, size_t size) noexcept
+{
+    size_t lines = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (str[i] == '\n') {
+            ++lines;
+        }
+    }
+    return lines;
+}
+
+constexpr ShaderChunk makeChunk(const char* file, const char* data) noexcept
+{
+    const size_t size = length(data);
+    return { file, data, size, countLines(data, size), pbr::hash::fnv1a(data, size) };
+}
+
+// Evaluated by the compiler: the largest chunks take a few hundred thousand constexpr steps,
+// MSVC needs /constexpr:steps raised accordingly.
+constexpr ShaderChunk CHUNKS[] = {
+#define PBR_SHADER_CHUNK(id, file) makeChunk(file, SHADERS_##id##_DATA),
+    PBR_SHADER_CHUNKS(PBR_SHADER_CHUNK)
+#undef PBR_SHADER_CHUNK
+};
+
+static_assert(sizeof(CHUNKS) / sizeof(CHUNKS[0]) == size_t(pbr::ShaderChunkId::COUNT),
+        "CHUNKS must have one entry per ShaderChunkId");
+
+constexpr uint64_t hashChunks() noexcept
+{
+    uint64_t h = pbr::hash::FNV1A_OFFSET;
+    for (const ShaderChunk& chunk : CHUNKS) {
+        for (int i = 0; i < 8; i++) {
+            h = (h ^ uint8_t(chunk.hash >> (i * 8))) * pbr::hash::FNV1A_PRIME;
+        }
+    }
+    return h;
+}
+
+constexpr uint64_t CHUNKS_HASH = hashChunks();
+
+}
+
+namespace pbr
+{
+
+const ShaderChunk& ShaderChunks::Get(ShaderChunkId id) noexcept
+{
+    return CHUNKS[size_t(id)];
+}
+
+const ShaderChunk* ShaderChunks::GetAll() noexcept
+{
+    return CHUNKS;
+}
+
+uint64_t ShaderChunks::GetHash() noexcept
+{
+    return CHUNKS_HASH;
+}
+
+}
@@ -21,45 +21,27 @@
 #include "pbr/MaterialEnums.h"
 #include "pbr/UibGenerator.h"
 #include "pbr/SibGenerator.h"
+#include "pbr/Hash.h"
+#include "pbr/SamplerLayers.h"
+#include "pbr/ShaderChunks.h"
+#include "pbr/Trace.h"
 
-#include "shaders/ambient_occlusion.fs"
-#include "shaders/brdf.fs"
-#include "shaders/common_getters.fs"
-#include "shaders/common_graphics.fs"
-#include "shaders/common_lighting.fs"
-#include "shaders/common_material.fs"
-#include "shaders/common_math.fs"
-#include "shaders/common_shading.fs"
-#include "shaders/common_types.fs"
-#include "shaders/depth_main.fs"
-#include "shaders/depth_main.vs"
-#include "shaders/getters.fs"
-#include "shaders/getters.vs"
-#include "shaders/inputs.fs"
-#include "shaders/inputs.vs"
-#include "shaders/light_directional.fs"
-#include "shaders/light_indirect.fs"
-#include "shaders/light_punctual.fs"
-#include "shaders/main.vs"
-#include "shaders/main.fs"
-#include "shaders/material_inputs.fs"
-#include "shaders/material_inputs.vs"
-#include "shaders/shading_lit.fs"
-#include "shaders/shading_model_cloth.fs"
-#include "shaders/shading_model_standard.fs"
-#include "shaders/shading_model_subsurface.fs"
-#include "shaders/shading_parameters.fs"
-#include "shaders/shading_unlit.fs"
-#include "shaders/shadowing.fs"
-#include "shaders/shadowing.vs"
-
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 
 #include <assert.h>
 
 namespace
 {
 
+void appendChunk(pbr::CodeGenerator& cg, pbr::ShaderChunkId id) noexcept
+{
+    const pbr::ShaderChunk& chunk = pbr::ShaderChunks::Get(id);
+    cg.Chunk(chunk.data, chunk.size, chunk.lines);
+}
+
 const char* getShadingDefine(pbr::Shading shading) noexcept
 {
     switch (shading) {
@@ -133,42 +115,133 @@ char const* getUniformTypeName(pbr::UniformType type) noexcept
     }
 }
 
-size_t countLines(const char* s) noexcept
+size_t countLines(const std::string& s) noexcept
 {
-    size_t lines = 0;
-    size_t i = 0;
-    while (s[i] != 0) {
-        if (s[i++] == '\n') lines++;
-    }
-    return lines;
+    return pbr::CodeGenerator::CountLines(s.data(), s.size());
 }
 
-size_t countLines(const std::string& s) noexcept
+// The material code with #line directives around it, as a line of its own after firstLine lines.
+std::string materialSection(const std::string& shader, size_t lineOffset, size_t firstLine) noexcept
 {
-    size_t lines = 0;
-    for (char i : s) {
-        if (i == '\n') lines++;
+    if (shader.empty()) {
+        return "";
+    }
+
+    size_t lines = firstLine;
+    std::stringstream ss;
+    ss << "#line " << lineOffset;
+    if (shader[0] != '\n') ss << "\n";
+    ss << shader.c_str();
+    if (shader[shader.size() - 1] != '\n') {
+        ss << "\n";
+        lines++;
     }
-    return lines;
+    // + 2 to account for the #line directives we just added
+    ss << "#line " << lines + countLines(shader) + 2 << "\n";
+    ss << "\n";
+    return ss.str();
 }
 
-void appendShader(pbr::CodeGenerator& cg, const std::string& shader, size_t lineOffset) noexcept
+// Generated code before or after the material code of a program.
+struct ProgramPart
 {
-    if (!shader.empty())
+    std::string text;
+    size_t lines;
+};
+
+// Program parts shared by all the generators. Everything around the material code only depends
+// on the generation flavor, the variant and the material's flags and interface blocks, which are
+// the same for most materials: once a configuration has been seen, generating a program is just
+// splicing the material code between two cached buffers.
+class ProgramPartCache
+{
+public:
+    template<typename Generate>
+    std::shared_ptr<const ProgramPart> Get(uint64_t key, Generate generate)
     {
-        size_t lines = countLines(cg.ToText());
-        std::stringstream ss;
-        ss << "#line " << lineOffset;
-        if (shader[0] != '\n') ss << "\n";
-        ss << shader.c_str();
-        if (shader[shader.size() - 1] != '\n') {
-            ss << "\n";
-            lines++;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto itr = mParts.find(key);
+            if (itr != mParts.end()) {
+                return itr->second;
+            }
         }
-        // + 2 to account for the #line directives we just added
-        ss << "#line " << lines + countLines(shader) + 2 << "\n";
-        cg.Line(ss.str());
+
+        // generated outside of the lock, two threads may race on the same part but they produce
+        // the same text
+        PBR_TRACE_SCOPE("generate program part");
+        pbr::CodeGenerator cg;
+        generate(cg);
+        auto part = std::make_shared<ProgramPart>();
+        part->text = cg.ToText();
+        part->lines = cg.GetLineCount();
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        // crude bound for long running processes, the parts of a material are regenerated at once
+        if (mParts.size() >= MAX_PARTS) {
+            mParts.clear();
+        }
+        return mParts.emplace(key, std::move(part)).first->second;
     }
+
+private:
+    static const size_t MAX_PARTS = 1024;
+
+    std::mutex mMutex;
+    std::unordered_map<uint64_t, std::shared_ptr<const ProgramPart>> mParts;
+
+}; // ProgramPartCache
+
+ProgramPartCache& getProgramPartCache()
+{
+    static ProgramPartCache cache;
+    return cache;
+}
+
+std::string assembleProgram(const ProgramPart& prefix, const std::string& material,
+                            const ProgramPart& suffix)
+{
+    std::string program;
+    program.reserve(prefix.text.size() + material.size() + suffix.text.size());
+    program.append(prefix.text).append(material).append(suffix.text);
+    return program;
+}
+
+void hashUniformBlock(pbr::hash::Hasher& hasher, const pbr::UniformInterfaceBlock& uib) noexcept
+{
+    hasher.Add(uib.getName());
+    for (auto const& info : uib.getUniformInfoList()) {
+        hasher.Add(info.name).Add(info.offset).Add(info.stride).Add(info.type)
+              .Add(info.size).Add(info.precision);
+    }
+}
+
+void hashSamplerBlock(pbr::hash::Hasher& hasher, const pbr::SamplerInterfaceBlock& sib) noexcept
+{
+    hasher.Add(sib.getName());
+    for (auto const& info : sib.getSamplerInfoList()) {
+        hasher.Add(info.name).Add(info.offset).Add(info.type).Add(info.format)
+              .Add(info.multisample).Add(info.precision);
+    }
+}
+
+// Hash of everything compiled into the generator itself: the shader chunks and the engine's
+// uniform and sampler blocks. Part of every program key, so that cached programs are invalidated
+// when the generator changes.
+uint64_t getGeneratorFingerprint() noexcept
+{
+    static const uint64_t fingerprint = []() {
+        pbr::hash::Hasher hasher;
+        hasher.Add(pbr::MATERIAL_VERSION);
+        hasher.Add(pbr::ShaderChunks::GetHash());
+        hashUniformBlock(hasher, pbr::UibGenerator::getPerViewUib());
+        hashUniformBlock(hasher, pbr::UibGenerator::getPerRenderableUib());
+        hashUniformBlock(hasher, pbr::UibGenerator::getPerRenderableBonesUib());
+        hashUniformBlock(hasher, pbr::UibGenerator::getLightsUib());
+        hashSamplerBlock(hasher, pbr::SibGenerator::getPerViewSib());
+        return hasher.Get();
+    }();
+    return fingerprint;
 }
 
 bool isMobileTarget(pbr::ShaderModel model)
@@ -222,12 +295,50 @@ ShaderGenerator::ShaderGenerator(MaterialBuilder::PropertyList const& properties
 const std::string ShaderGenerator::createVertexProgram(
     ShaderModel sm, MaterialBuilder::TargetApi targetApi,
     MaterialBuilder::TargetLanguage targetLanguage, MaterialInfo const& material,
-    uint8_t variantKey, Interpolation interpolation, VertexDomain vertexDomain) const noexcept
+    uint8_t variantKey, Interpolation interpolation, VertexDomain vertexDomain) noexcept
 {
-    CodeGenerator cg;
-    const bool lit = material.isLit;
+    mShaderModel    = sm;
+    mTargetApi      = targetApi;
+    mTargetLanguage = targetLanguage;
+
     const Variant variant(variantKey);
 
+    // these variants are special and are treated as DEPTH variants. Filament will never
+    // request that variant for the color pass.
+    const bool depthOnly = variant.isDepthPass() &&
+        (material.blendingMode != BlendingMode::MASKED) &&
+        !hasCustomDepthShader();
+
+    hash::Hasher prefixKey;
+    hashPrefixInputs(prefixKey, ShaderType::VERTEX, sm, targetApi, targetLanguage, material,
+            variantKey, interpolation, vertexDomain);
+    auto prefix = getProgramPartCache().Get(prefixKey.Get(), [&](CodeGenerator& cg) {
+        generateVertexPrefix(cg, material, variant, interpolation, vertexDomain);
+    });
+
+    hash::Hasher suffixKey;
+    suffixKey.Add(getGeneratorFingerprint()).Add(ShaderType::VERTEX).Add(false)
+             .Add(mShaderModel).Add(mTargetApi).Add(mTargetLanguage).Add(depthOnly);
+    auto suffix = getProgramPartCache().Get(suffixKey.Get(), [&](CodeGenerator& cg) {
+        if (depthOnly) {
+            generateDepthShaderMain(cg, ShaderType::VERTEX);
+        } else {
+            // main entry point
+            generateShaderMain(cg, ShaderType::VERTEX);
+        }
+        generateEpilog(cg);
+    });
+
+    return assembleProgram(*prefix, depthOnly ? std::string() :
+            materialSection(rewriteSamplerLayers(mMaterialVertexCode, material),
+                    mMaterialVertexLineOffset, prefix->lines), *suffix);
+}
+
+void ShaderGenerator::generateVertexPrefix(CodeGenerator& cg, MaterialInfo const& material,
+    Variant variant, Interpolation interpolation, VertexDomain vertexDomain) const
+{
+    const bool lit = material.isLit;
+
     generateProlog(cg, ShaderType::VERTEX, material.hasExternalSamplers);
 
     generateDefine(cg, "FLIP_UV_ATTRIBUTE", material.flipUV);
@@ -250,7 +361,9 @@ const std::string ShaderGenerator::createVertexProgram(
     // custom material variables
     size_t variableIndex = 0;
     for (const auto& variable : mVariables) {
-        generateVariable(cg, ShaderType::VERTEX, variable, variableIndex++);
+        generateVariable(cg, ShaderType::VERTEX, variable,
+                material.variablePrecisions[variableIndex], variableIndex);
+        variableIndex++;
     }
 
     // materials defines
@@ -276,32 +389,62 @@ const std::string ShaderGenerator::createVertexProgram(
     generateCommon(cg, ShaderType::VERTEX);
     generateGetters(cg, ShaderType::VERTEX);
     generateCommonMaterial(cg, ShaderType::VERTEX);
-
-    if (variant.isDepthPass() &&
-        (material.blendingMode != BlendingMode::MASKED) &&
-        !hasCustomDepthShader()) {
-        // these variants are special and are treated as DEPTH variants. Filament will never
-        // request that variant for the color pass.
-        generateDepthShaderMain(cg, ShaderType::VERTEX);
-    } else {
-        // main entry point
-        appendShader(cg, mMaterialVertexCode, mMaterialVertexLineOffset);
-        generateShaderMain(cg, ShaderType::VERTEX);
-    }
-
-    generateEpilog(cg);
-
-    return cg.ToText();
 }
 
 const std::string ShaderGenerator::createFragmentProgram(
     ShaderModel shaderModel, MaterialBuilder::TargetApi targetApi,
     MaterialBuilder::TargetLanguage targetLanguage, MaterialInfo const& material,
-    uint8_t variantKey, Interpolation interpolation) const noexcept
+    uint8_t variantKey, Interpolation interpolation) noexcept
 {
-    CodeGenerator cg;
-    const bool lit = material.isLit;
+    mShaderModel    = shaderModel;
+    mTargetApi      = targetApi;
+    mTargetLanguage = targetLanguage;
+
     const Variant variant(variantKey);
+    const bool depth = variant.isDepthPass();
+    const bool materialCode = !depth || material.blendingMode == BlendingMode::MASKED;
+
+    hash::Hasher prefixKey;
+    hashPrefixInputs(prefixKey, ShaderType::FRAGMENT, shaderModel, targetApi, targetLanguage,
+            material, variantKey, interpolation, VertexDomain::OBJECT);
+    auto prefix = getProgramPartCache().Get(prefixKey.Get(), [&](CodeGenerator& cg) {
+        generateFragmentPrefix(cg, material, variant, interpolation);
+    });
+
+    hash::Hasher suffixKey;
+    suffixKey.Add(getGeneratorFingerprint()).Add(ShaderType::FRAGMENT).Add(false)
+             .Add(mShaderModel).Add(mTargetApi).Add(mTargetLanguage).Add(depth);
+    if (!depth) {
+        suffixKey.Add(variantKey).Add(material.isLit).Add(material.shading)
+                 .Add(material.hasShadowMultiplier);
+    }
+    auto suffix = getProgramPartCache().Get(suffixKey.Get(), [&](CodeGenerator& cg) {
+        // shading model
+        if (depth) {
+            // these variants are special and are treated as DEPTH variants. Filament will never
+            // request that variant for the color pass.
+            generateDepthShaderMain(cg, ShaderType::FRAGMENT);
+        } else {
+            if (material.isLit) {
+                generateShaderLit(cg, ShaderType::FRAGMENT, variant, material.shading);
+            } else {
+                generateShaderUnlit(cg, ShaderType::FRAGMENT, variant, material.hasShadowMultiplier);
+            }
+            // entry point
+            generateShaderMain(cg, ShaderType::FRAGMENT);
+        }
+        generateEpilog(cg);
+    });
+
+    return assembleProgram(*prefix, materialCode ?
+            materialSection(rewriteSamplerLayers(mMaterialCode, material),
+                    mMaterialLineOffset, prefix->lines) : std::string(), *suffix);
+}
+
+void ShaderGenerator::generateFragmentPrefix(CodeGenerator& cg, MaterialInfo const& material,
+    Variant variant, Interpolation interpolation) const
+{
+    const bool lit = material.isLit;
 
     generateProlog(cg, ShaderType::FRAGMENT, material.hasExternalSamplers);
 
@@ -313,11 +456,11 @@ const std::string ShaderGenerator::createFragmentProgram(
     generateDefine(cg, "CLEAR_COAT_IOR_CHANGE", material.clearCoatIorChange);
 
     bool specularAO = material.specularAOSet ?
-            material.specularAO : !isMobileTarget(shaderModel);
+            material.specularAO : !isMobileTarget(mShaderModel);
     generateDefine(cg, "SPECULAR_AMBIENT_OCCLUSION", specularAO ? 1u : 0u);
 
     bool multiBounceAO = material.multiBounceAOSet ?
-            material.multiBounceAO : !isMobileTarget(shaderModel);
+            material.multiBounceAO : !isMobileTarget(mShaderModel);
     generateDefine(cg, "MULTI_BOUNCE_AMBIENT_OCCLUSION", multiBounceAO ? 1u : 0u);
 
     // lighting variants
@@ -381,7 +524,9 @@ const std::string ShaderGenerator::createFragmentProgram(
     // custom material variables
     size_t variableIndex = 0;
     for (const auto& variable : mVariables) {
-        generateVariable(cg, ShaderType::FRAGMENT, variable, variableIndex++);
+        generateVariable(cg, ShaderType::FRAGMENT, variable,
+                material.variablePrecisions[variableIndex], variableIndex);
+        variableIndex++;
     }
 
     // uniforms and samplers
@@ -404,29 +549,60 @@ const std::string ShaderGenerator::createFragmentProgram(
     generateGetters(cg, ShaderType::FRAGMENT);
     generateCommonMaterial(cg, ShaderType::FRAGMENT);
     generateParameters(cg, ShaderType::FRAGMENT);
+}
 
-    // shading model
-    if (variant.isDepthPass()) {
-        if (material.blendingMode == BlendingMode::MASKED) {
-            appendShader(cg, mMaterialCode, mMaterialLineOffset);
-        }
-        // these variants are special and are treated as DEPTH variants. Filament will never
-        // request that variant for the color pass.
-        generateDepthShaderMain(cg, ShaderType::FRAGMENT);
-    } else {
-        appendShader(cg, mMaterialCode, mMaterialLineOffset);
-        if (material.isLit) {
-            generateShaderLit(cg, ShaderType::FRAGMENT, variant, material.shading);
-        } else {
-            generateShaderUnlit(cg, ShaderType::FRAGMENT, variant, material.hasShadowMultiplier);
-        }
-        // entry point
-        generateShaderMain(cg, ShaderType::FRAGMENT);
-    }
+uint64_t ShaderGenerator::getProgramKey(ShaderType type, ShaderModel sm,
+    MaterialBuilder::TargetApi targetApi, MaterialBuilder::TargetLanguage targetLanguage,
+    MaterialInfo const& material, uint8_t variantKey, Interpolation interpolation,
+    VertexDomain vertexDomain) const noexcept
+{
+    hash::Hasher hasher;
+    hashPrefixInputs(hasher, type, sm, targetApi, targetLanguage, material, variantKey,
+            interpolation, vertexDomain);
+
+    // the material code also covers the #line directives generated from the offsets
+    hasher.Add(mMaterialCode).Add(uint64_t(mMaterialLineOffset));
+    hasher.Add(mMaterialVertexCode).Add(uint64_t(mMaterialVertexLineOffset));
+
+    return hasher.Get();
+}
 
-    generateEpilog(cg);
+void ShaderGenerator::hashPrefixInputs(hash::Hasher& hasher, ShaderType type, ShaderModel sm,
+    MaterialBuilder::TargetApi targetApi, MaterialBuilder::TargetLanguage targetLanguage,
+    MaterialInfo const& material, uint8_t variantKey, Interpolation interpolation,
+    VertexDomain vertexDomain) const noexcept
+{
+    hasher.Add(getGeneratorFingerprint());
+
+    // true for prefixes, suffix keys hash false at the same position
+    hasher.Add(type).Add(true).Add(sm).Add(targetApi).Add(targetLanguage)
+          .Add(variantKey).Add(interpolation).Add(vertexDomain);
+
+    for (bool property : mProperties) {
+        hasher.Add(property);
+    }
+    for (auto const& variable : mVariables) {
+        hasher.Add(variable);
+    }
+    for (Precision precision : material.variablePrecisions) {
+        hasher.Add(precision);
+    }
 
-    return cg.ToText();
+    hasher.Add(material.isLit).Add(material.hasDoubleSidedCapability)
+          .Add(material.hasExternalSamplers).Add(material.hasShadowMultiplier)
+          .Add(material.specularAntiAliasing).Add(material.clearCoatIorChange)
+          .Add(material.flipUV).Add(material.multiBounceAO).Add(material.multiBounceAOSet)
+          .Add(material.specularAO).Add(material.specularAOSet)
+          .Add(uint64_t(material.requiredAttributes.to_ulong()))
+          .Add(material.blendingMode).Add(material.postLightingBlendingMode)
+          .Add(material.shading);
+    hashUniformBlock(hasher, material.uib);
+    hashSamplerBlock(hasher, material.sib);
+    for (auto const& layer : material.samplerLayers) {
+        hasher.Add(layer.sampler).Add(layer.array).Add(layer.layer);
+    }
+    hasher.Add(material.samplerBindings.getBlockOffset(BindingPoints::PER_VIEW))
+          .Add(material.samplerBindings.getBlockOffset(BindingPoints::PER_MATERIAL_INSTANCE));
 }
 
 bool ShaderGenerator::hasCustomDepthShader() const noexcept
@@ -492,7 +668,7 @@ void ShaderGenerator::generateProlog(CodeGenerator& cg, ShaderType type, bool ha
         cg.Line("invariant gl_Position;");
     }
 
-    cg.Line(SHADERS_COMMON_TYPES_FS_DATA);
+    appendChunk(cg, pbr::ShaderChunkId::COMMON_TYPES_FS);
 
     cg.Line("");
 }
@@ -504,31 +680,31 @@ void ShaderGenerator::generateEpilog(CodeGenerator& cg) const
 
 void ShaderGenerator::generateCommon(CodeGenerator& cg, ShaderType type) const
 {
-    cg.Line(SHADERS_COMMON_MATH_FS_DATA);
+    appendChunk(cg, pbr::ShaderChunkId::COMMON_MATH_FS);
     if (type == ShaderType::VERTEX) {
     } else if (type == ShaderType::FRAGMENT) {
-        cg.Line(SHADERS_COMMON_SHADING_FS_DATA);
-        cg.Line(SHADERS_COMMON_GRAPHICS_FS_DATA);
-        cg.Line(SHADERS_COMMON_MATERIAL_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::COMMON_SHADING_FS);
+        appendChunk(cg, pbr::ShaderChunkId::COMMON_GRAPHICS_FS);
+        appendChunk(cg, pbr::ShaderChunkId::COMMON_MATERIAL_FS);
     }
 }
 
 void ShaderGenerator::generateCommonMaterial(CodeGenerator& cg, ShaderType type) const
 {
     if (type == ShaderType::VERTEX) {
-        cg.Line(SHADERS_MATERIAL_INPUTS_VS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::MATERIAL_INPUTS_VS);
     } else if (type == ShaderType::FRAGMENT) {
-        cg.Line(SHADERS_MATERIAL_INPUTS_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::MATERIAL_INPUTS_FS);
     }
 }
 
 void ShaderGenerator::generateShaderMain(CodeGenerator& cg, ShaderType type) const
 {
     if (type == ShaderType::VERTEX) {
-        cg.Line(SHADERS_SHADOWING_VS_DATA);
-        cg.Line(SHADERS_MAIN_VS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::SHADOWING_VS);
+        appendChunk(cg, pbr::ShaderChunkId::MAIN_VS);
     } else if (type == ShaderType::FRAGMENT) {
-        cg.Line(SHADERS_MAIN_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::MAIN_FS);
     }
 }
 
@@ -539,40 +715,40 @@ void ShaderGenerator::generateShaderLit(CodeGenerator& cg, ShaderType type, Vari
     }
     else if (type == ShaderType::FRAGMENT)
     {
-        cg.Line(SHADERS_COMMON_LIGHTING_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::COMMON_LIGHTING_FS);
         if (variant.hasShadowReceiver()) {
-            cg.Line(SHADERS_SHADOWING_FS_DATA);
+            appendChunk(cg, pbr::ShaderChunkId::SHADOWING_FS);
         }
 
-        cg.Line(SHADERS_BRDF_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::BRDF_FS);
         switch (shading) {
             case Shading::UNLIT:
                 assert("Lit shader generated with unlit shading model");
                 break;
             case Shading::SPECULAR_GLOSSINESS:
             case Shading::LIT:
-                cg.Line(SHADERS_SHADING_MODEL_STANDARD_FS_DATA);
+                appendChunk(cg, pbr::ShaderChunkId::SHADING_MODEL_STANDARD_FS);
                 break;
             case Shading::SUBSURFACE:
-                cg.Line(SHADERS_SHADING_MODEL_SUBSURFACE_FS_DATA);
+                appendChunk(cg, pbr::ShaderChunkId::SHADING_MODEL_SUBSURFACE_FS);
                 break;
             case Shading::CLOTH:
-                cg.Line(SHADERS_SHADING_MODEL_CLOTH_FS_DATA);
+                appendChunk(cg, pbr::ShaderChunkId::SHADING_MODEL_CLOTH_FS);
                 break;
         }
 
         if (shading != Shading::UNLIT) {
-            cg.Line(SHADERS_AMBIENT_OCCLUSION_FS_DATA);
-            cg.Line(SHADERS_LIGHT_INDIRECT_FS_DATA);
+            appendChunk(cg, pbr::ShaderChunkId::AMBIENT_OCCLUSION_FS);
+            appendChunk(cg, pbr::ShaderChunkId::LIGHT_INDIRECT_FS);
         }
         if (variant.hasDirectionalLighting()) {
-            cg.Line(SHADERS_LIGHT_DIRECTIONAL_FS_DATA);
+            appendChunk(cg, pbr::ShaderChunkId::LIGHT_DIRECTIONAL_FS);
         }
         if (variant.hasDynamicLighting()) {
-            cg.Line(SHADERS_LIGHT_PUNCTUAL_FS_DATA);
+            appendChunk(cg, pbr::ShaderChunkId::LIGHT_PUNCTUAL_FS);
         }
 
-        cg.Line(SHADERS_SHADING_LIT_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::SHADING_LIT_FS);
     }
 }
 
@@ -582,10 +758,10 @@ void ShaderGenerator::generateShaderUnlit(CodeGenerator& cg, ShaderType type, Va
     } else if (type == ShaderType::FRAGMENT) {
         if (hasShadowMultiplier) {
             if (variant.hasShadowReceiver()) {
-                cg.Line(SHADERS_SHADOWING_FS_DATA);
+                appendChunk(cg, pbr::ShaderChunkId::SHADOWING_FS);
             }
         }
-        cg.Line(SHADERS_SHADING_UNLIT_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::SHADING_UNLIT_FS);
     }
 }
 
@@ -643,25 +819,35 @@ void ShaderGenerator::generateShaderInputs(CodeGenerator& cg, ShaderType type, c
         if (hasBoneWeights) {
             generateDefine(cg, "LOCATION_BONE_WEIGHTS", uint32_t(VertexAttribute::BONE_WEIGHTS));
         }
-        cg.Line(SHADERS_INPUTS_VS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::INPUTS_VS);
     } else if (type == ShaderType::FRAGMENT) {
-        cg.Line(SHADERS_INPUTS_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::INPUTS_FS);
     }
 }
 
-void ShaderGenerator::generateVariable(CodeGenerator& cg, ShaderType type, const std::string& name, size_t index) const
+void ShaderGenerator::generateVariable(CodeGenerator& cg, ShaderType type, const std::string& name,
+                                       Precision precision, size_t index) const
 {
     if (!name.empty())
     {
+        // highp unless lowered, see MaterialBuilder::SetPrecisionLowering()
+        const char* qualifier = getPrecisionQualifier(
+                precision == Precision::DEFAULT ? Precision::HIGH : precision, Precision::DEFAULT);
         if (type == ShaderType::VERTEX)
         {
             cg.LineFmt("\n#define VARIABLE_CUSTOM%d %s", index, name.c_str());
             cg.LineFmt("\n#define VARIABLE_CUSTOM_AT%d variable_%s", index, name.c_str());
-            cg.LineFmt("LAYOUT_LOCATION(%d) out vec4 variable_%s;", index, name.c_str());
+            if (precision == Precision::DEFAULT || precision == Precision::HIGH) {
+                cg.LineFmt("LAYOUT_LOCATION(%d) out vec4 variable_%s;", index, name.c_str());
+            } else {
+                cg.LineFmt("LAYOUT_LOCATION(%d) out %s vec4 variable_%s;", index, qualifier,
+                        name.c_str());
+            }
         }
         else if (type == ShaderType::FRAGMENT)
         {
-            cg.LineFmt("\nLAYOUT_LOCATION(%d) in highp vec4 variable_%s;", index, name.c_str());
+            cg.LineFmt("\nLAYOUT_LOCATION(%d) in %s vec4 variable_%s;", index, qualifier,
+                    name.c_str());
         }
     }
 }
@@ -669,9 +855,9 @@ void ShaderGenerator::generateVariable(CodeGenerator& cg, ShaderType type, const
 void ShaderGenerator::generateDepthShaderMain(CodeGenerator& cg, ShaderType type) const
 {
     if (type == ShaderType::VERTEX) {
-        cg.Line(SHADERS_DEPTH_MAIN_VS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::DEPTH_MAIN_VS);
     } else if (type == ShaderType::FRAGMENT) {
-        cg.Line(SHADERS_DEPTH_MAIN_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::DEPTH_MAIN_FS);
     }
 }
 
@@ -683,8 +869,7 @@ void ShaderGenerator::generateUniforms(CodeGenerator& cg, ShaderType type, uint8
     }
 
     const std::string& blockName = uib.getName();
-    std::string instanceName(uib.getName().c_str());
-    std::transform(instanceName.begin(), instanceName.end(), instanceName.begin(), ::tolower);
+    const std::string instanceName = getInstanceName(uib);
 
     Precision uniformPrecision = getDefaultUniformPrecision();
     Precision defaultPrecision = getDefaultPrecision(type);
@@ -714,7 +899,31 @@ void ShaderGenerator::generateUniforms(CodeGenerator& cg, ShaderType type, uint8
         ss << ";";
         cg.Line(ss.str());
     }
-    cg.LineFmt("} %s;", instanceName);
+    cg.LineFmt("} %s;", instanceName.c_str());
+}
+
+std::string ShaderGenerator::getInstanceName(const UniformInterfaceBlock& uib) noexcept
+{
+    std::string instanceName(uib.getName().c_str());
+    std::transform(instanceName.begin(), instanceName.end(), instanceName.begin(), ::tolower);
+    return instanceName;
+}
+
+std::string ShaderGenerator::rewriteSamplerLayers(const std::string& code,
+                                                  MaterialInfo const& material) const noexcept
+{
+    if (material.samplerLayers.empty()) {
+        return code;
+    }
+    const char* sibName = material.sib.getName().c_str();
+    const std::string instanceName = getInstanceName(material.uib);
+    std::vector<SamplerLayers::Names> names;
+    for (auto const& layer : material.samplerLayers) {
+        names.push_back({ SamplerInterfaceBlock::getUniformName(sibName, layer.sampler.c_str()),
+                SamplerInterfaceBlock::getUniformName(sibName, layer.array.c_str()),
+                instanceName + "." + layer.layer });
+    }
+    return SamplerLayers::Rewrite(code, names);
 }
 
 void ShaderGenerator::generateSamplers(CodeGenerator& cg, uint8_t firstBinding,
@@ -807,11 +1016,11 @@ void ShaderGenerator::generateDefine(CodeGenerator& cg, const char* name, const
 
 void ShaderGenerator::generateGetters(CodeGenerator& cg, ShaderType type) const
 {
-    cg.Line(SHADERS_COMMON_GETTERS_FS_DATA);
+    appendChunk(cg, pbr::ShaderChunkId::COMMON_GETTERS_FS);
     if (type == ShaderType::VERTEX) {
-        cg.Line(SHADERS_GETTERS_VS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::GETTERS_VS);
     } else if (type == ShaderType::FRAGMENT) {
-        cg.Line(SHADERS_GETTERS_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::GETTERS_FS);
     }
 }
 
@@ -819,7 +1028,7 @@ void ShaderGenerator::generateParameters(CodeGenerator& cg, ShaderType type) con
 {
     if (type == ShaderType::VERTEX) {
     } else if (type == ShaderType::FRAGMENT) {
-        cg.Line(SHADERS_SHADING_PARAMETERS_FS_DATA);
+        appendChunk(cg, pbr::ShaderChunkId::SHADING_PARAMETERS_FS);
     }
 }
 
@@ -884,6 +1093,14 @@ char const* ShaderGenerator::getSamplerTypeName(SamplerType type, SamplerFormat
             // are created via VK_ANDROID_external_memory_android_hardware_buffer, but they are
             // backed by VkImage just like a normal texture, and sampled from normally.
             return (mTargetLanguage == MaterialBuilder::TargetLanguage::SPIRV) ? "sampler2D" : "samplerExternalOES";
+        case SamplerType::SAMPLER_2D_ARRAY:
+            assert(!multisample);
+            switch (format) {
+                case SamplerFormat::INT:    return "isampler2DArray";
+                case SamplerFormat::UINT:   return "usampler2DArray";
+                case SamplerFormat::FLOAT:  return "sampler2DArray";
+                case SamplerFormat::SHADOW: return "sampler2DArrayShadow";
+            }
         default: return"";
     }
 }
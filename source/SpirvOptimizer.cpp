@@ -0,0 +1,136 @@
+#include "pbr/SpirvOptimizer.h"
+
+#include <spirv-tools/optimizer.hpp>
+
+#include <sstream>
+
+namespace
+{
+
+// SPIR-V module header: magic, version, generator, bound, schema.
+const size_t SPIRV_HEADER_WORDS = 5;
+
+void registerPerformancePasses(spvtools::Optimizer& optimizer)
+{
+    optimizer
+        .RegisterPass(spvtools::CreateMergeReturnPass())
+        .RegisterPass(spvtools::CreateInlineExhaustivePass())
+        .RegisterPass(spvtools::CreateAggressiveDCEPass())
+        .RegisterPass(spvtools::CreatePrivateToLocalPass())
+        .RegisterPass(spvtools::CreateLocalSingleBlockLoadStoreElimPass())
+        .RegisterPass(spvtools::CreateLocalSingleStoreElimPass())
+        .RegisterPass(spvtools::CreateAggressiveDCEPass())
+        .RegisterPass(spvtools::CreateScalarReplacementPass())
+        .RegisterPass(spvtools::CreateLocalAccessChainConvertPass())
+        .RegisterPass(spvtools::CreateLocalSingleBlockLoadStoreElimPass())
+        .RegisterPass(spvtools::CreateLocalSingleStoreElimPass())
+        .RegisterPass(spvtools::CreateAggressiveDCEPass())
+        .RegisterPass(spvtools::CreateLocalMultiStoreElimPass())
+        .RegisterPass(spvtools::CreateAggressiveDCEPass())
+        // fold the constant conditions, then drop the branches they never take
+        .RegisterPass(spvtools::CreateCCPPass())
+        .RegisterPass(spvtools::CreateAggressiveDCEPass())
+        .RegisterPass(spvtools::CreateDeadBranchElimPass())
+        .RegisterPass(spvtools::CreateLoopUnrollPass(true))
+        .RegisterPass(spvtools::CreateDeadBranchElimPass())
+        .RegisterPass(spvtools::CreateRedundancyEliminationPass())
+        .RegisterPass(spvtools::CreateCombineAccessChainsPass())
+        .RegisterPass(spvtools::CreateSimplificationPass())
+        .RegisterPass(spvtools::CreateVectorDCEPass())
+        .RegisterPass(spvtools::CreateDeadInsertElimPass())
+        .RegisterPass(spvtools::CreateDeadBranchElimPass())
+        .RegisterPass(spvtools::CreateSimplificationPass())
+        .RegisterPass(spvtools::CreateIfConversionPass())
+        .RegisterPass(spvtools::CreateCopyPropagateArraysPass())
+        .RegisterPass(spvtools::CreateReduceLoadSizePass())
+        .RegisterPass(spvtools::CreateAggressiveDCEPass())
+        .RegisterPass(spvtools::CreateBlockMergePass())
+        .RegisterPass(spvtools::CreateRedundancyEliminationPass())
+        .RegisterPass(spvtools::CreateDeadBranchElimPass())
+        .RegisterPass(spvtools::CreateBlockMergePass())
+        .RegisterPass(spvtools::CreateSimplificationPass())
+        .RegisterPass(spvtools::CreateEliminateDeadFunctionsPass())
+        .RegisterPass(spvtools::CreateEliminateDeadConstantPass());
+}
+
+void registerSizePasses(spvtools::Optimizer& optimizer)
+{
+    optimizer.RegisterPass(spvtools::CreateStripDebugInfoPass());
+    optimizer.RegisterSizePasses();
+    optimizer.RegisterPass(spvtools::CreateCompactIdsPass());
+}
+
+}
+
+namespace pbr
+{
+
+SpirvOptimizer::SpirvOptimizer(MaterialBuilder::Optimization optimization,
+                               MaterialBuilder::TargetApi targetApi)
+    : mOptimization(optimization)
+    , mTargetApi(targetApi)
+{
+}
+
+bool SpirvOptimizer::Optimize(std::vector<uint32_t>& spirv, std::ostream& err) const noexcept
+{
+    if (mOptimization == MaterialBuilder::Optimization::NONE || spirv.empty()) {
+        return true;
+    }
+
+    spv_target_env env = mTargetApi == MaterialBuilder::TargetApi::VULKAN ?
+            SPV_ENV_VULKAN_1_0 : SPV_ENV_OPENGL_4_5;
+
+    // spvtools::Optimizer keeps per run state in its passes, so each call gets its own
+    spvtools::Optimizer optimizer(env);
+
+    std::stringstream errors;
+    optimizer.SetMessageConsumer([&errors](spv_message_level_t level, const char* source,
+            const spv_position_t& position, const char* message) {
+        if (level <= SPV_MSG_ERROR) {
+            errors << "ERROR: " << (source ? source : "") << ":" << position.index << ": "
+                   << message << std::endl;
+        }
+    });
+
+    switch (mOptimization)
+    {
+    case MaterialBuilder::Optimization::PERFORMANCE:
+        registerPerformancePasses(optimizer);
+        break;
+    case MaterialBuilder::Optimization::SIZE:
+        registerSizePasses(optimizer);
+        break;
+    default:
+        break;
+    }
+
+    std::vector<uint32_t> optimized;
+    if (!optimizer.Run(spirv.data(), spirv.size(), &optimized)) {
+        err << "ERROR: Unable to optimize SPIR-V" << std::endl;
+        err << errors.str() << std::flush;
+        return false;
+    }
+
+    spirv.swap(optimized);
+    return true;
+}
+
+size_t SpirvOptimizer::CountInstructions(const std::vector<uint32_t>& spirv) noexcept
+{
+    size_t count = 0;
+    size_t i = SPIRV_HEADER_WORDS;
+    while (i < spirv.size())
+    {
+        // the high half of an instruction's first word is its length in words
+        const size_t words = spirv[i] >> 16;
+        if (words == 0) {
+            break;
+        }
+        i += words;
+        ++count;
+    }
+    return count;
+}
+
+}
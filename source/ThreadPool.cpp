@@ -0,0 +1,121 @@
+#include "pbr/ThreadPool.h"
+
+#include <algorithm>
+
+namespace pbr
+{
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // the calling thread of ParallelFor() is the last worker
+    for (size_t i = 1; i < threadCount; i++) {
+        mWorkers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCondition.notify_all();
+    for (auto& t : mWorkers) {
+        t.join();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+    if (count == 0) {
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto run = [&next, count, &func]() {
+        for (size_t i = next++; i < count; i = next++) {
+            func(i);
+        }
+    };
+
+    if (mWorkers.empty() || count == 1) {
+        run();
+        return;
+    }
+
+    // one job per worker that can be useful, each job drains indices until none are left
+    const size_t jobCount = std::min(count - 1, mWorkers.size());
+    std::mutex doneLock;
+    std::condition_variable doneCondition;
+    size_t pending = jobCount;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (size_t i = 0; i < jobCount; i++) {
+            mJobs.emplace_back([&]() {
+                run();
+                std::lock_guard<std::mutex> lock(doneLock);
+                if (--pending == 0) {
+                    doneCondition.notify_all();
+                }
+            });
+        }
+    }
+    mCondition.notify_all();
+
+    run();
+
+    // help with queued jobs (possibly our own) instead of blocking, this keeps nested calls
+    // from dead-locking when every worker is itself waiting.
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(doneLock);
+            if (pending == 0) {
+                break;
+            }
+        }
+        if (!RunPendingJob()) {
+            std::unique_lock<std::mutex> lock(doneLock);
+            doneCondition.wait(lock, [&pending]() { return pending == 0; });
+            break;
+        }
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mCondition.wait(lock, [this]() { return mExit || !mJobs.empty(); });
+            if (mJobs.empty()) {
+                return;
+            }
+            job = std::move(mJobs.front());
+            mJobs.pop_front();
+        }
+        job();
+    }
+}
+
+bool ThreadPool::RunPendingJob()
+{
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mJobs.empty()) {
+            return false;
+        }
+        job = std::move(mJobs.front());
+        mJobs.pop_front();
+    }
+    job();
+    return true;
+}
+
+}
@@ -0,0 +1,212 @@
+#include "pbr/Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdio.h>
+
+namespace
+{
+
+struct Event
+{
+    const char* name;
+    std::string detail;
+    int variant;
+    int64_t begin;
+    int64_t end;
+};
+
+// Spans of one thread. Only that thread appends to it, the lock is there for the readers and
+// is therefore uncontended while building.
+struct ThreadBuffer
+{
+    uint32_t tid;
+    std::mutex lock;
+    std::vector<Event> events;
+};
+
+// Buffers outlive their threads, so that spans of finished workers can still be exported.
+struct Registry
+{
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry& getRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+ThreadBuffer& getThreadBuffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        Registry& registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.lock);
+        registry.buffers.emplace_back(new ThreadBuffer);
+        buffer = registry.buffers.back().get();
+        buffer->tid = uint32_t(registry.buffers.size());
+    }
+    return *buffer;
+}
+
+// Calls func(tid, event) for every recorded event.
+template<typename Func>
+void forEachEvent(Func func)
+{
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    for (auto& buffer : registry.buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->lock);
+        for (auto const& event : buffer->events) {
+            func(buffer->tid, event);
+        }
+    }
+}
+
+void writeJsonString(std::ostream& out, const char* str)
+{
+    out << '"';
+    for (; *str; str++) {
+        const char c = *str;
+        switch (c) {
+            case '"':  out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n";  break;
+            case '\t': out << "\\t";  break;
+            default:
+                if (uint8_t(c) < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out << buf;
+                } else {
+                    out << c;
+                }
+                break;
+        }
+    }
+    out << '"';
+}
+
+}
+
+namespace pbr
+{
+
+std::atomic<bool> Trace::sEnabled(false);
+
+void Trace::Enable(bool enable) noexcept
+{
+    // sets the time origin before the first span
+    Now();
+    sEnabled.store(enable, std::memory_order_relaxed);
+}
+
+void Trace::Clear() noexcept
+{
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    for (auto& buffer : registry.buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->lock);
+        buffer->events.clear();
+    }
+}
+
+void Trace::WriteChromeTrace(std::ostream& out)
+{
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    char buf[64];
+    forEachEvent([&](uint32_t tid, const Event& event) {
+        out << (first ? "" : ",\n") << "{\"name\":";
+        writeJsonString(out, event.name);
+        // trace event times are in microseconds
+        snprintf(buf, sizeof(buf), ",\"ts\":%.3f,\"dur\":%.3f", event.begin / 1000.0,
+                (event.end - event.begin) / 1000.0);
+        out << ",\"cat\":\"pbr\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << buf;
+        if (!event.detail.empty() || event.variant >= 0) {
+            out << ",\"args\":{";
+            if (!event.detail.empty()) {
+                out << "\"material\":";
+                writeJsonString(out, event.detail.c_str());
+            }
+            if (event.variant >= 0) {
+                out << (event.detail.empty() ? "" : ",") << "\"variant\":" << event.variant;
+            }
+            out << "}";
+        }
+        out << "}";
+        first = false;
+    });
+    out << "\n]}\n";
+}
+
+bool Trace::WriteChromeTrace(const std::string& filepath)
+{
+    std::ofstream fout(filepath);
+    if (!fout) {
+        std::cerr << "ERROR: Unable to write " << filepath << std::endl;
+        return false;
+    }
+    WriteChromeTrace(fout);
+    return bool(fout);
+}
+
+void Trace::PrintSummary(std::ostream& out)
+{
+    struct Stat
+    {
+        size_t count = 0;
+        int64_t total = 0;
+        int64_t max = 0;
+    };
+    std::map<std::string, Stat> stats;
+    forEachEvent([&](uint32_t, const Event& event) {
+        Stat& stat = stats[event.name];
+        const int64_t duration = event.end - event.begin;
+        stat.count++;
+        stat.total += duration;
+        stat.max = std::max(stat.max, duration);
+    });
+
+    std::vector<std::pair<std::string, Stat>> sorted(stats.begin(), stats.end());
+    std::sort(sorted.begin(), sorted.end(), [](auto const& lhs, auto const& rhs) {
+        return lhs.second.total > rhs.second.total;
+    });
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-32s %8s %12s %12s %12s\n", "phase", "count", "total ms",
+            "mean ms", "max ms");
+    out << line;
+    for (auto const& entry : sorted) {
+        const Stat& stat = entry.second;
+        snprintf(line, sizeof(line), "%-32s %8zu %12.3f %12.3f %12.3f\n", entry.first.c_str(),
+                stat.count, stat.total / 1e6, stat.total / 1e6 / stat.count, stat.max / 1e6);
+        out << line;
+    }
+}
+
+int64_t Trace::Now() noexcept
+{
+    using clock = std::chrono::steady_clock;
+    static const clock::time_point origin = clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - origin).count();
+}
+
+void Trace::Record(const char* name, const char* detail, int variant, int64_t begin,
+                   int64_t end) noexcept
+{
+    ThreadBuffer& buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.lock);
+    buffer.events.push_back({ name, detail ? detail : "", variant, begin, end });
+}
+
+}
@@ -0,0 +1,83 @@
+#include "pbr/UniformBlockAllocator.h"
+
+#include <iostream>
+
+#include <assert.h>
+
+namespace pbr
+{
+
+UniformBlockAllocator::UniformBlockAllocator(size_t bufferSize, size_t alignment,
+                                             size_t maxBuffers)
+    : mBufferSize(bufferSize)
+    , mAlignment(alignment)
+    , mMaxBuffers(maxBuffers)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    // the head starts in a full buffer, so that the first allocation adds one
+    mHead = mBufferSize;
+}
+
+UniformBlockAllocator::Allocation UniformBlockAllocator::Allocate(size_t size) noexcept
+{
+    const size_t alignedSize = (size + mAlignment - 1) & ~(mAlignment - 1);
+    if (size == 0 || alignedSize > mBufferSize) {
+        std::cerr << "ERROR: Unable to allocate a uniform block of " << size << " bytes"
+                  << std::endl;
+        return Allocation();
+    }
+
+    Allocation allocation;
+    auto it = mFreeBlocks.find(uint32_t(alignedSize));
+    if (it != mFreeBlocks.end() && !it->second.empty()) {
+        allocation = it->second.back();
+        it->second.pop_back();
+    } else {
+        if (mHead + alignedSize > mBufferSize) {
+            // the tail of the last buffer is left unused
+            if (mBuffers.size() >= mMaxBuffers) {
+                std::cerr << "ERROR: Unable to allocate a uniform block of " << size
+                          << " bytes, all " << mMaxBuffers << " buffers are full" << std::endl;
+                return Allocation();
+            }
+            mBuffers.emplace_back(new uint8_t[mBufferSize]);
+            mHead = 0;
+        }
+        allocation.buffer = uint32_t(mBuffers.size() - 1);
+        allocation.offset = uint32_t(mHead);
+        allocation.size = uint32_t(alignedSize);
+        allocation.data = mBuffers.back().get() + mHead;
+        mHead += alignedSize;
+    }
+
+    mAllocatedSize += alignedSize;
+    return allocation;
+}
+
+void UniformBlockAllocator::Free(const Allocation& allocation) noexcept
+{
+    if (!allocation.IsValid()) {
+        return;
+    }
+    assert(allocation.buffer < mBuffers.size());
+    mPending.push_back({ mFrameFence, allocation });
+    mAllocatedSize -= allocation.size;
+    mPendingSize += allocation.size;
+}
+
+UniformBlockAllocator::Fence UniformBlockAllocator::EndFrame() noexcept
+{
+    return mFrameFence++;
+}
+
+void UniformBlockAllocator::Signal(Fence fence) noexcept
+{
+    while (!mPending.empty() && mPending.front().fence <= fence) {
+        const Allocation& allocation = mPending.front().allocation;
+        mFreeBlocks[allocation.size].push_back(allocation);
+        mPendingSize -= allocation.size;
+        mPending.pop_front();
+    }
+}
+
+}
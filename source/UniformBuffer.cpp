@@ -0,0 +1,50 @@
+#include "pbr/UniformBuffer.h"
+
+namespace pbr
+{
+
+UniformBuffer::UniformBuffer(const UniformInterfaceBlock& uib)
+    : mBlock(uib)
+    , mSize(uib.getSize())
+{
+    // getSize() is rounded to a float4
+    mStorage.resize((mSize + sizeof(Slot) - 1) / sizeof(Slot));
+    memset(mStorage.data(), 0, mStorage.size() * sizeof(Slot));
+    Invalidate();
+}
+
+UniformBuffer::Handle UniformBuffer::GetHandle(const std::string& name) const noexcept
+{
+    const int32_t index = mBlock.getUniformIndex(name);
+    return index < 0 ? INVALID_HANDLE : Handle(index);
+}
+
+void UniformBuffer::SetMat3(Handle handle, const float value[9], size_t index) noexcept
+{
+    // std140 pads each column to a float4
+    float columns[12] = {
+        value[0], value[1], value[2], 0.0f,
+        value[3], value[4], value[5], 0.0f,
+        value[6], value[7], value[8], 0.0f
+    };
+    Write(handle, UniformType::MAT3, index, columns, sizeof(columns));
+}
+
+UniformBuffer::Range UniformBuffer::Flush() noexcept
+{
+    Range range = { 0, 0 };
+    if (IsDirty()) {
+        range = { mDirtyBegin, mDirtyEnd - mDirtyBegin };
+    }
+    mDirtyBegin = mSize;
+    mDirtyEnd = 0;
+    return range;
+}
+
+void UniformBuffer::Invalidate() noexcept
+{
+    mDirtyBegin = 0;
+    mDirtyEnd = mSize;
+}
+
+}
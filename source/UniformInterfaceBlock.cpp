@@ -16,23 +16,59 @@
 
 #include "pbr/UniformInterfaceBlock.h"
 
+#include <iomanip>
+#include <ostream>
+
 namespace pbr
 {
 
 UniformInterfaceBlock::UniformInterfaceBlock(Builder const& builder) noexcept
     : mName(builder.mName)
 {
-    auto& infoMap = mInfoMap;
-    auto& uniformsInfoList = mUniformsInfoList;
-    infoMap.reserve(builder.mEntries.size());
-    uniformsInfoList.resize(builder.mEntries.size());
+    EntryList entries;
+    entries.reserve(builder.mEntries.size());
+    for (auto const& e : builder.mEntries) {
+        entries.push_back(&e);
+    }
+
+    mUnpackedSize = layout(entries, nullptr);
+    if (builder.mPacking) {
+        pack(entries);
+    }
+    mSize = layout(entries, &mUniformsInfoList);
+
+    mInfoMap.reserve(mUniformsInfoList.size());
+    for (uint32_t i = 0; i < mUniformsInfoList.size(); i++) {
+        mInfoMap[mUniformsInfoList[i].name.c_str()] = i;
+    }
+}
+
+void UniformInterfaceBlock::printLayout(std::ostream& out) const
+{
+    out << mName << ": " << mSize << " bytes";
+    if (mSize != mUnpackedSize) {
+        out << ", " << mUnpackedSize - mSize << " saved by packing";
+    }
+    out << std::endl;
+    for (auto const& info : mUniformsInfoList) {
+        out << "  " << std::setw(4) << info.getBufferOffset() << "  " << std::setw(4)
+            << info.stride * info.size * sizeof(uint32_t) << "  " << info.name << std::endl;
+    }
+}
+
+uint32_t UniformInterfaceBlock::layout(const EntryList& entries,
+                                       std::vector<UniformInfo>* infos) noexcept
+{
+    if (infos) {
+        infos->resize(entries.size());
+    }
 
     uint32_t i = 0;
     uint16_t offset = 0;
-    for (auto const& e : builder.mEntries) {
-        size_t alignment = baseAlignmentForType(e.type);
-        uint8_t stride = strideForType(e.type);
-        if (e.size > 1) { // this is an array
+    for (auto const* e : entries) {
+        size_t alignment = baseAlignmentForType(e->type);
+        uint8_t stride = strideForType(e->type);
+        if (e->size > 1) { // this is an array
             // round the alignment up to that of a float4
             alignment = (alignment + 3) & ~3;
             stride = (stride + uint8_t(3)) & ~uint8_t(3);
@@ -42,19 +78,48 @@ UniformInterfaceBlock::UniformInterfaceBlock(Builder const& builder) noexcept
         size_t padding = (alignment - (offset % alignment)) % alignment;
         offset += padding;
 
-        UniformInfo& info = uniformsInfoList[i];
-        info = { e.name, offset, stride, e.type, e.size, e.precision };
-
-        // record this uniform info
-        infoMap[info.name.c_str()] = i;
+        if (infos) {
+            (*infos)[i] = { e->name, offset, stride, e->type, e->size, e->precision };
+        }
 
         // advance offset to next slot
-        offset += stride * e.size;
+        offset += stride * e->size;
         ++i;
     }
 
     // round size to the next multiple of 4 and convert to bytes
-    mSize = sizeof(uint32_t) * ((offset + 3) & ~3);
+    return sizeof(uint32_t) * ((offset + 3) & ~3);
+}
+
+void UniformInterfaceBlock::pack(EntryList& entries) noexcept
+{
+    // Arrays, matrices and 4 components types fill whole float4 slots and go first. Each float3
+    // is followed by a scalar in its tail, then come the float2s and the remaining scalars.
+    // Only the float3s left without a scalar are padded. Declaration order is kept otherwise.
+    EntryList slots, vec3s, vec2s, scalars;
+    for (auto const* e : entries) {
+        const uint8_t stride = strideForType(e->type);
+        if (e->size > 1 || stride % 4 == 0) {
+            slots.push_back(e);
+        } else if (stride == 3) {
+            vec3s.push_back(e);
+        } else if (stride == 2) {
+            vec2s.push_back(e);
+        } else {
+            scalars.push_back(e);
+        }
+    }
+
+    entries = std::move(slots);
+    size_t scalar = 0;
+    for (auto const* e : vec3s) {
+        entries.push_back(e);
+        if (scalar < scalars.size()) {
+            entries.push_back(scalars[scalar++]);
+        }
+    }
+    entries.insert(entries.end(), vec2s.begin(), vec2s.end());
+    entries.insert(entries.end(), scalars.begin() + scalar, scalars.end());
 }
 
 uint8_t UniformInterfaceBlock::baseAlignmentForType(UniformType type) noexcept
@@ -0,0 +1,421 @@
+// Benchmark of the material compiler over a synthetic corpus: every Shading and BlendingMode,
+// 0 to 32 parameters, up to the maximum number of material samplers, all the variant keys and
+// both shader models. Reports latency percentiles, bytes generated and heap allocations for each
+// phase, so that regressions show up as the generator is optimized. Also times the froxelization
+// of CONFIG_MAX_LIGHT_COUNT punctual lights at 1080p, which the runtime does every frame.
+//
+// usage: pbr_bench [-i iterations] [--no-analysis] [--trace file.json]
+
+#include "pbr/CodeGenerator.h"
+#include "pbr/Froxelizer.h"
+#include "pbr/GLSLTools.h"
+#include "pbr/MaterialInfo.h"
+#include "pbr/MaterialPackage.h"
+#include "pbr/ShaderGenerator.h"
+#include "pbr/SibGenerator.h"
+#include "pbr/ThreadPool.h"
+#include "pbr/Trace.h"
+#include "pbr/Variant.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+
+std::atomic<size_t> gAllocations(0);
+
+}
+
+// Counts every heap allocation of the process, the phases read the counter around their work.
+void* operator new(size_t size)
+{
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+// C++14 sized deallocation would otherwise call the library version on memory from malloc.
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+namespace
+{
+
+using namespace pbr;
+
+const Shading SHADINGS[] = {
+    Shading::UNLIT, Shading::LIT, Shading::SUBSURFACE, Shading::CLOTH, Shading::SPECULAR_GLOSSINESS
+};
+
+const BlendingMode BLENDING_MODES[] = {
+    BlendingMode::B_OPAQUE, BlendingMode::B_TRANSPARENT, BlendingMode::ADD, BlendingMode::MASKED,
+    BlendingMode::FADE, BlendingMode::MULTIPLY, BlendingMode::SCREEN
+};
+
+const ShaderModel SHADER_MODELS[] = { ShaderModel::GL_ES_30, ShaderModel::GL_CORE_41 };
+
+const size_t UNIFORM_COUNTS[] = { 0, 1, 4, 16, 32 };
+
+const char* getShadingName(Shading shading)
+{
+    switch (shading) {
+        case Shading::UNLIT:               return "unlit";
+        case Shading::LIT:                 return "lit";
+        case Shading::SUBSURFACE:          return "subsurface";
+        case Shading::CLOTH:               return "cloth";
+        case Shading::SPECULAR_GLOSSINESS: return "specularGlossiness";
+        default: return "";
+    }
+}
+
+struct Material
+{
+    std::string name;
+    MaterialInfo info;
+    MaterialBuilder::PropertyList properties;
+    std::string code;
+};
+
+// Samplers left for the material once the engine's per-view samplers are bound.
+size_t getMaxMaterialSamplers()
+{
+    return MAX_SAMPLER_COUNT - SibGenerator::getPerViewSib().getSamplerInfoList().size();
+}
+
+Material makeMaterial(Shading shading, BlendingMode blending, size_t uniformCount,
+                      size_t samplerCount)
+{
+    static const UniformType UNIFORM_TYPES[] = {
+        UniformType::FLOAT, UniformType::FLOAT2, UniformType::FLOAT3, UniformType::FLOAT4
+    };
+    static const char* SWIZZLES[] = { ".xxxx", ".xyyy", ".xyzz", "" };
+
+    Material m;
+    m.name = std::string(getShadingName(shading)) + "_" + std::to_string(int(blending)) + "_u" +
+             std::to_string(uniformCount) + "_s" + std::to_string(samplerCount);
+
+    std::fill_n(m.properties, MaterialBuilder::MATERIAL_PROPERTIES_COUNT, false);
+    m.properties[size_t(MaterialBuilder::Property::BASE_COLOR)] = true;
+    if (shading != Shading::UNLIT) {
+        m.properties[size_t(MaterialBuilder::Property::ROUGHNESS)] = true;
+    }
+
+    std::string body = "    prepareMaterial(material);\n    vec4 color = vec4(1.0);\n";
+
+    UniformInterfaceBlock::Builder ibb;
+    for (size_t i = 0; i < uniformCount; i++) {
+        const std::string name = "param" + std::to_string(i);
+        ibb.add(name, 1, UNIFORM_TYPES[i % 4]);
+        body += "    color *= vec4(materialParams." + name + ")" + SWIZZLES[i % 4] + ";\n";
+    }
+    if (blending == BlendingMode::MASKED) {
+        ibb.add("_maskThreshold", 1, UniformType::FLOAT);
+    }
+
+    SamplerInterfaceBlock::Builder sbb;
+    for (size_t i = 0; i < samplerCount; i++) {
+        const std::string name = "texture" + std::to_string(i);
+        sbb.add(name, SamplerType::SAMPLER_2D, SamplerFormat::FLOAT, Precision::MEDIUM);
+        body += "    color *= texture(materialParams_" + name + ", getUV0());\n";
+    }
+
+    body += "    material.baseColor = color;\n";
+    m.code = "void material(inout MaterialInputs material) {\n" + body + "}\n";
+
+    MaterialInfo& info = m.info;
+    info.isLit = shading != Shading::UNLIT;
+    info.hasDoubleSidedCapability = false;
+    info.hasExternalSamplers = false;
+    info.hasShadowMultiplier = false;
+    info.specularAntiAliasing = false;
+    info.clearCoatIorChange = true;
+    info.flipUV = true;
+    info.multiBounceAO = false;
+    info.multiBounceAOSet = false;
+    info.specularAO = false;
+    info.specularAOSet = false;
+    info.requiredAttributes.set(size_t(VertexAttribute::POSITION));
+    info.requiredAttributes.set(size_t(VertexAttribute::UV0));
+    if (info.isLit) {
+        info.requiredAttributes.set(size_t(VertexAttribute::TANGENTS));
+    }
+    info.blendingMode = blending;
+    info.postLightingBlendingMode = BlendingMode::B_TRANSPARENT;
+    info.shading = shading;
+    info.uib = ibb.name("MaterialParams").build();
+    info.sib = sbb.name("MaterialParams").build();
+    info.samplerBindings.populate(&info.sib, m.name.c_str());
+
+    return m;
+}
+
+std::vector<Material> makeCorpus()
+{
+    const size_t maxSamplers = getMaxMaterialSamplers();
+    const size_t samplerCounts[] = { 0, 1, maxSamplers / 2, maxSamplers };
+
+    std::vector<Material> corpus;
+    for (auto shading : SHADINGS) {
+        for (auto blending : BLENDING_MODES) {
+            for (size_t uniforms : UNIFORM_COUNTS) {
+                for (size_t samplers : samplerCounts) {
+                    // parameters are uniforms and samplers, at most MAX_PARAMETERS_COUNT
+                    if (uniforms + samplers > MaterialBuilder::MAX_PARAMETERS_COUNT) {
+                        continue;
+                    }
+                    corpus.push_back(makeMaterial(shading, blending, uniforms, samplers));
+                }
+            }
+        }
+    }
+    return corpus;
+}
+
+// A grid of point and spot lights in front of the camera, overlapping each other.
+std::vector<Froxelizer::Light> makeLights()
+{
+    std::vector<Froxelizer::Light> lights(CONFIG_MAX_LIGHT_COUNT);
+    for (size_t i = 0; i < lights.size(); i++) {
+        Froxelizer::Light& light = lights[i];
+        light.position[0] = float(i % 16) * 2.0f - 15.0f;
+        light.position[1] = float(i / 16 % 4) - 2.0f;
+        light.position[2] = -2.0f - float(i / 16) * 3.0f;
+        light.radius = 2.0f + float(i % 5);
+        light.direction[0] = 0.0f;
+        light.direction[1] = -1.0f;
+        light.direction[2] = 0.0f;
+        light.cosOuterAngle = 0.7f;
+        light.spot = i % 2 == 1;
+    }
+    return lights;
+}
+
+// Latencies, output bytes and allocations of one phase.
+class Phase
+{
+public:
+    explicit Phase(const char* name) : mName(name) {}
+
+    template<typename Func>
+    void Run(Func func)
+    {
+        const size_t allocations = gAllocations.load(std::memory_order_relaxed);
+        auto begin = std::chrono::steady_clock::now();
+        const size_t bytes = func();
+        auto end = std::chrono::steady_clock::now();
+        mAllocations += gAllocations.load(std::memory_order_relaxed) - allocations;
+        mBytes += bytes;
+        mSamples.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+    }
+
+    void Print()
+    {
+        if (mSamples.empty()) {
+            return;
+        }
+        std::sort(mSamples.begin(), mSamples.end());
+        auto percentile = [this](double p) {
+            return mSamples[std::min(mSamples.size() - 1, size_t(p * mSamples.size()))];
+        };
+        double total = 0;
+        for (double s : mSamples) {
+            total += s;
+        }
+        const double count = double(mSamples.size());
+        printf("%-10s %8zu %10.1f %10.1f %10.1f %10.1f %10.1f %12.0f %10.1f\n", mName,
+                mSamples.size(), total / count, percentile(0.5), percentile(0.9),
+                percentile(0.99), mSamples.back(), mBytes / count, mAllocations / count);
+    }
+
+    static void PrintHeader()
+    {
+        printf("%-10s %8s %10s %10s %10s %10s %10s %12s %10s\n", "phase", "count", "mean us",
+                "p50 us", "p90 us", "p99 us", "max us", "bytes/op", "allocs/op");
+    }
+
+private:
+    const char* mName;
+    std::vector<double> mSamples;
+    double mBytes = 0;
+    double mAllocations = 0;
+
+}; // Phase
+
+void printUsage()
+{
+    std::cerr << "usage: pbr_bench [-i iterations] [--no-analysis] [--trace file.json]" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    size_t iterations = 1;
+    bool analysis = true;
+    const char* tracePath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            iterations = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--no-analysis")) {
+            analysis = false;
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    pbr::Trace::Enable(tracePath != nullptr);
+
+    const std::vector<Material> corpus = makeCorpus();
+    printf("%zu materials x %zu shader models x %zu variants, %zu iteration(s)\n\n",
+            corpus.size(), sizeof(SHADER_MODELS) / sizeof(SHADER_MODELS[0]), VARIANT_COUNT,
+            iterations);
+
+    // The generator caches the code around the material code across calls, the first iteration
+    // therefore measures cold generation and the next ones warm generation.
+    Phase vertex("vertex");
+    Phase fragment("fragment");
+    Phase toText("toText");
+    Phase analyze("analyze");
+    Phase package("package");
+
+    GLSLTools tools;
+    MaterialBuilder::VariableList variables;
+    size_t failures = 0;
+    for (size_t iteration = 0; iteration < iterations; iteration++)
+    {
+        for (auto const& m : corpus)
+        {
+            MaterialPackageWriter writer(m.name, m.info);
+            writer.SetLineDictionary(true);
+
+            for (auto model : SHADER_MODELS)
+            {
+                ShaderGenerator sg(m.properties, variables, m.code, 0, std::string(), 0);
+                MaterialBuilder::ShaderOutput out = { model, MaterialBuilder::TargetApi::OPENGL,
+                        MaterialBuilder::TargetLanguage::GLSL, MaterialBuilder::Optimization::NONE,
+                        MaterialBuilder::Minification::NONE, ShaderType::VERTEX, 0, std::string(),
+                        {}, 0, 0 };
+
+                for (uint8_t k = 0; k < VARIANT_COUNT; k++)
+                {
+                    out.variantKey = k;
+
+                    out.type = ShaderType::VERTEX;
+                    vertex.Run([&]() {
+                        out.shader = sg.createVertexProgram(model, out.targetApi,
+                                out.targetLanguage, m.info, k, Interpolation::SMOOTH,
+                                VertexDomain::OBJECT);
+                        return out.shader.size();
+                    });
+                    writer.AddShader(out);
+
+                    out.type = ShaderType::FRAGMENT;
+                    fragment.Run([&]() {
+                        out.shader = sg.createFragmentProgram(model, out.targetApi,
+                                out.targetLanguage, m.info, k, Interpolation::SMOOTH);
+                        return out.shader.size();
+                    });
+                    writer.AddShader(out);
+                }
+
+                // assembling a fragment program from its lines
+                CodeGenerator cg;
+                for (size_t begin = 0; begin < out.shader.size(); ) {
+                    size_t end = out.shader.find('\n', begin);
+                    if (end == std::string::npos) {
+                        end = out.shader.size();
+                    }
+                    cg.Line(out.shader.substr(begin, end - begin));
+                    begin = end + 1;
+                }
+                toText.Run([&]() {
+                    return cg.ToText().size();
+                });
+
+                // variant 0 holds the material code, it is the one getting the full analysis
+                if (analysis && iteration == 0) {
+                    const std::string shader = sg.createFragmentProgram(model, out.targetApi,
+                            out.targetLanguage, m.info, 0, Interpolation::SMOOTH);
+                    analyze.Run([&]() {
+                        if (!tools.AnalyzeFragmentShader(shader, model, out.targetApi)) {
+                            std::cerr << "ERROR: " << m.name << " failed analysis" << std::endl;
+                            failures++;
+                        }
+                        return size_t(0);
+                    });
+                }
+            }
+
+            package.Run([&]() {
+                std::vector<uint8_t> data;
+                writer.Write(data);
+                return data.size();
+            });
+        }
+    }
+
+    // 60 degrees vertical fov, 0.1 to 100 m, camera at the origin
+    const float width = 1920.0f, height = 1080.0f, near = 0.1f, far = 100.0f;
+    const float focal = 1.0f / tanf(3.14159265f / 6.0f);
+    const float clipFromView[16] = {
+        focal * height / width, 0, 0, 0,
+        0, focal, 0, 0,
+        0, 0, -(far + near) / (far - near), -1,
+        0, 0, -2.0f * far * near / (far - near), 0
+    };
+    const float viewFromWorld[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    const std::vector<Froxelizer::Light> lights = makeLights();
+
+    Phase froxelize("froxelize");
+    ThreadPool pool;
+    Froxelizer froxelizer;
+    froxelizer.SetViewport(0, 0, uint32_t(width), uint32_t(height));
+    froxelizer.SetProjection(clipFromView, 5.0f, far);
+    for (size_t frame = 0; frame < iterations * 100; frame++) {
+        froxelize.Run([&]() {
+            if (!froxelizer.Froxelize(pool, viewFromWorld, lights.data(), lights.size())) {
+                failures++;
+            }
+            return froxelizer.GetRecordCount();
+        });
+    }
+
+    Phase::PrintHeader();
+    vertex.Print();
+    fragment.Print();
+    toText.Print();
+    analyze.Print();
+    package.Print();
+    froxelize.Print();
+
+    if (tracePath) {
+        printf("\n");
+        pbr::Trace::PrintSummary(std::cout);
+        pbr::Trace::WriteChromeTrace(tracePath);
+    }
+
+    return failures ? 1 : 0;
+}
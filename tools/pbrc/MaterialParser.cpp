@@ -0,0 +1,457 @@
+#include "MaterialParser.h"
+
+#include <sstream>
+#include <vector>
+
+#include <stdlib.h>
+
+namespace
+{
+
+template<typename T>
+struct Name
+{
+    const char* name;
+    T value;
+};
+
+template<typename T, size_t N>
+bool lookup(const Name<T> (&names)[N], const std::string& name, T& value)
+{
+    for (auto const& entry : names) {
+        if (name == entry.name) {
+            value = entry.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+const Name<pbr::Shading> SHADINGS[] = {
+    { "unlit",              pbr::Shading::UNLIT },
+    { "lit",                pbr::Shading::LIT },
+    { "subsurface",         pbr::Shading::SUBSURFACE },
+    { "cloth",              pbr::Shading::CLOTH },
+    { "specularGlossiness", pbr::Shading::SPECULAR_GLOSSINESS },
+};
+
+const Name<pbr::BlendingMode> BLENDING_MODES[] = {
+    { "opaque",      pbr::BlendingMode::B_OPAQUE },
+    { "transparent", pbr::BlendingMode::B_TRANSPARENT },
+    { "add",         pbr::BlendingMode::ADD },
+    { "masked",      pbr::BlendingMode::MASKED },
+    { "fade",        pbr::BlendingMode::FADE },
+    { "multiply",    pbr::BlendingMode::MULTIPLY },
+    { "screen",      pbr::BlendingMode::SCREEN },
+};
+
+const Name<pbr::Interpolation> INTERPOLATIONS[] = {
+    { "smooth", pbr::Interpolation::SMOOTH },
+    { "flat",   pbr::Interpolation::FLAT },
+};
+
+const Name<pbr::VertexDomain> VERTEX_DOMAINS[] = {
+    { "object", pbr::VertexDomain::OBJECT },
+    { "world",  pbr::VertexDomain::WORLD },
+    { "view",   pbr::VertexDomain::VIEW },
+    { "device", pbr::VertexDomain::DEVICE },
+};
+
+const Name<pbr::VertexAttribute> ATTRIBUTES[] = {
+    { "position",    pbr::VertexAttribute::POSITION },
+    { "tangents",    pbr::VertexAttribute::TANGENTS },
+    { "color",       pbr::VertexAttribute::COLOR },
+    { "uv0",         pbr::VertexAttribute::UV0 },
+    { "uv1",         pbr::VertexAttribute::UV1 },
+    { "boneIndices", pbr::VertexAttribute::BONE_INDICES },
+    { "boneWeights", pbr::VertexAttribute::BONE_WEIGHTS },
+};
+
+const Name<pbr::MaterialBuilder::Property> PROPERTIES[] = {
+    { "baseColor",          pbr::MaterialBuilder::Property::BASE_COLOR },
+    { "roughness",          pbr::MaterialBuilder::Property::ROUGHNESS },
+    { "metallic",           pbr::MaterialBuilder::Property::METALLIC },
+    { "reflectance",        pbr::MaterialBuilder::Property::REFLECTANCE },
+    { "ambientOcclusion",   pbr::MaterialBuilder::Property::AMBIENT_OCCLUSION },
+    { "clearCoat",          pbr::MaterialBuilder::Property::CLEAR_COAT },
+    { "clearCoatRoughness", pbr::MaterialBuilder::Property::CLEAR_COAT_ROUGHNESS },
+    { "clearCoatNormal",    pbr::MaterialBuilder::Property::CLEAR_COAT_NORMAL },
+    { "anisotropy",         pbr::MaterialBuilder::Property::ANISOTROPY },
+    { "anisotropyDirection",pbr::MaterialBuilder::Property::ANISOTROPY_DIRECTION },
+    { "thickness",          pbr::MaterialBuilder::Property::THICKNESS },
+    { "subsurfacePower",    pbr::MaterialBuilder::Property::SUBSURFACE_POWER },
+    { "subsurfaceColor",    pbr::MaterialBuilder::Property::SUBSURFACE_COLOR },
+    { "sheenColor",         pbr::MaterialBuilder::Property::SHEEN_COLOR },
+    { "specularColor",      pbr::MaterialBuilder::Property::SPECULAR_COLOR },
+    { "glossiness",         pbr::MaterialBuilder::Property::GLOSSINESS },
+    { "emissive",           pbr::MaterialBuilder::Property::EMISSIVE },
+    { "normal",             pbr::MaterialBuilder::Property::NORMAL },
+    { "postLightingColor",  pbr::MaterialBuilder::Property::POST_LIGHTING_COLOR },
+};
+
+const Name<pbr::UniformType> UNIFORM_TYPES[] = {
+    { "bool",   pbr::UniformType::BOOL },
+    { "bool2",  pbr::UniformType::BOOL2 },
+    { "bool3",  pbr::UniformType::BOOL3 },
+    { "bool4",  pbr::UniformType::BOOL4 },
+    { "float",  pbr::UniformType::FLOAT },
+    { "float2", pbr::UniformType::FLOAT2 },
+    { "float3", pbr::UniformType::FLOAT3 },
+    { "float4", pbr::UniformType::FLOAT4 },
+    { "int",    pbr::UniformType::INT },
+    { "int2",   pbr::UniformType::INT2 },
+    { "int3",   pbr::UniformType::INT3 },
+    { "int4",   pbr::UniformType::INT4 },
+    { "uint",   pbr::UniformType::UINT },
+    { "uint2",  pbr::UniformType::UINT2 },
+    { "uint3",  pbr::UniformType::UINT3 },
+    { "uint4",  pbr::UniformType::UINT4 },
+    { "mat3",   pbr::UniformType::MAT3 },
+    { "mat4",   pbr::UniformType::MAT4 },
+};
+
+const Name<pbr::SamplerType> SAMPLER_TYPES[] = {
+    { "sampler2d",       pbr::SamplerType::SAMPLER_2D },
+    { "samplerCubemap",  pbr::SamplerType::SAMPLER_CUBEMAP },
+    { "samplerExternal", pbr::SamplerType::SAMPLER_EXTERNAL },
+    { "sampler2dArray",  pbr::SamplerType::SAMPLER_2D_ARRAY },
+};
+
+const Name<pbr::SamplerFormat> SAMPLER_FORMATS[] = {
+    { "int",    pbr::SamplerFormat::INT },
+    { "uint",   pbr::SamplerFormat::UINT },
+    { "float",  pbr::SamplerFormat::FLOAT },
+    { "shadow", pbr::SamplerFormat::SHADOW },
+};
+
+const Name<pbr::Precision> PRECISIONS[] = {
+    { "low",    pbr::Precision::LOW },
+    { "medium", pbr::Precision::MEDIUM },
+    { "high",   pbr::Precision::HIGH },
+};
+
+const Name<bool> BOOLEANS[] = {
+    { "true",  true },
+    { "false", false },
+};
+
+std::string trim(const std::string& str)
+{
+    const char* spaces = " \t\r";
+    const size_t begin = str.find_first_not_of(spaces);
+    if (begin == std::string::npos) {
+        return "";
+    }
+    return str.substr(begin, str.find_last_not_of(spaces) - begin + 1);
+}
+
+std::vector<std::string> split(const std::string& str, char separator)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, separator)) {
+        item = trim(item);
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::vector<std::string> splitWords(const std::string& str)
+{
+    std::vector<std::string> words;
+    std::stringstream ss(str);
+    std::string word;
+    while (ss >> word) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+}
+
+namespace pbr
+{
+
+MaterialParser::MaterialParser(const std::string& filepath, std::ostream& err)
+    : mFilepath(filepath)
+    , mErr(err)
+{
+}
+
+bool MaterialParser::Parse(const std::string& text, MaterialBuilder& builder)
+{
+    enum class Section { NONE, MATERIAL, FRAGMENT, VERTEX };
+
+    Section section = Section::NONE;
+    std::string code;
+    size_t codeLine = 0;
+    auto flushCode = [&]() {
+        if (section == Section::FRAGMENT) {
+            builder.SetMaterial(code, codeLine);
+        } else if (section == Section::VERTEX) {
+            builder.SetMaterialVertex(code, codeLine);
+        }
+        code.clear();
+    };
+
+    bool ok = true;
+    std::stringstream ss(text);
+    std::string line;
+    mLine = 0;
+    while (std::getline(ss, line))
+    {
+        mLine++;
+        const std::string trimmed = trim(line);
+
+        if (trimmed == "[material]" || trimmed == "[fragment]" || trimmed == "[vertex]") {
+            flushCode();
+            section = trimmed == "[material]" ? Section::MATERIAL :
+                      trimmed == "[fragment]" ? Section::FRAGMENT : Section::VERTEX;
+            codeLine = mLine + 1;
+            continue;
+        }
+
+        if (section == Section::FRAGMENT || section == Section::VERTEX) {
+            code += line;
+            code += '\n';
+            continue;
+        }
+
+        if (trimmed.empty() || trimmed[0] == ';' || trimmed[0] == '#') {
+            continue;
+        }
+        if (section != Section::MATERIAL) {
+            Error() << "expected a [material], [fragment] or [vertex] section" << std::endl;
+            ok = false;
+            continue;
+        }
+
+        const std::string content = trim(trimmed.substr(0, trimmed.find(';')));
+        const size_t equal = content.find('=');
+        if (equal == std::string::npos) {
+            Error() << "expected key = value" << std::endl;
+            ok = false;
+            continue;
+        }
+        const std::string key = trim(content.substr(0, equal));
+        const std::string value = trim(content.substr(equal + 1));
+        if (!ParseProperty(key, value, builder)) {
+            ok = false;
+        }
+    }
+    flushCode();
+
+    return ok;
+}
+
+bool MaterialParser::ParseProperty(const std::string& key, const std::string& value,
+                                   MaterialBuilder& builder)
+{
+    bool flag = false;
+    if (key == "name") {
+        builder.SetName(value);
+        return true;
+    }
+    if (key == "parameter") {
+        return ParseParameter(value, builder);
+    }
+    if (key == "range") {
+        return ParseRange(value, builder);
+    }
+    if (key == "shading") {
+        Shading shading;
+        if (lookup(SHADINGS, value, shading)) {
+            builder.SetShading(shading);
+            return true;
+        }
+    } else if (key == "blending" || key == "postLightingBlending") {
+        BlendingMode blending;
+        if (lookup(BLENDING_MODES, value, blending)) {
+            if (key == "blending") {
+                builder.SetBlending(blending);
+            } else {
+                builder.SetPostLightingBlending(blending);
+            }
+            return true;
+        }
+    } else if (key == "interpolation") {
+        Interpolation interpolation;
+        if (lookup(INTERPOLATIONS, value, interpolation)) {
+            builder.SetInterpolation(interpolation);
+            return true;
+        }
+    } else if (key == "vertexDomain") {
+        VertexDomain domain;
+        if (lookup(VERTEX_DOMAINS, value, domain)) {
+            builder.SetVertexDomain(domain);
+            return true;
+        }
+    } else if (key == "requires") {
+        for (auto const& name : split(value, ',')) {
+            VertexAttribute attribute;
+            if (!lookup(ATTRIBUTES, name, attribute)) {
+                Error() << "unknown vertex attribute " << name << std::endl;
+                return false;
+            }
+            builder.Require(attribute);
+        }
+        return true;
+    } else if (key == "properties") {
+        for (auto const& name : split(value, ',')) {
+            MaterialBuilder::Property property;
+            if (!lookup(PROPERTIES, name, property)) {
+                Error() << "unknown property " << name << std::endl;
+                return false;
+            }
+            builder.SetProperty(property);
+        }
+        return true;
+    } else if (key == "variables") {
+        auto names = split(value, ',');
+        if (names.size() > MaterialBuilder::MATERIAL_VARIABLES_COUNT) {
+            Error() << "at most " << MaterialBuilder::MATERIAL_VARIABLES_COUNT
+                    << " variables" << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < names.size(); i++) {
+            builder.SetVariable(MaterialBuilder::Variable(i), names[i]);
+        }
+        mVariables = names;
+        return true;
+    } else if (lookup(BOOLEANS, value, flag)) {
+        if (key == "doubleSided") {
+            builder.SetDoubleSided(flag);
+        } else if (key == "shadowMultiplier") {
+            builder.SetShadowMultiplier(flag);
+        } else if (key == "specularAntiAliasing") {
+            builder.SetSpecularAntiAliasing(flag);
+        } else if (key == "clearCoatIorChange") {
+            builder.SetClearCoatIorChange(flag);
+        } else if (key == "flipUV") {
+            builder.SetFlipUV(flag);
+        } else if (key == "multiBounceAO") {
+            builder.SetMultiBounceAmbientOcclusion(flag);
+        } else if (key == "specularAO") {
+            builder.SetSpecularAmbientOcclusion(flag);
+        } else if (key == "inferProperties") {
+            builder.SetPropertyInference(flag);
+        } else if (key == "inferAttributes") {
+            builder.SetAttributeInference(flag);
+        } else if (key == "precisionLowering") {
+            builder.SetPrecisionLowering(flag);
+        } else if (key == "samplerArrays") {
+            builder.SetSamplerArrays(flag);
+        } else {
+            Error() << "unknown key " << key << std::endl;
+            return false;
+        }
+        return true;
+    } else {
+        Error() << "unknown key " << key << std::endl;
+        return false;
+    }
+
+    Error() << "invalid value " << value << " for " << key << std::endl;
+    return false;
+}
+
+bool MaterialParser::ParseParameter(const std::string& value, MaterialBuilder& builder)
+{
+    auto words = splitWords(value);
+    if (words.size() < 2) {
+        Error() << "expected parameter = <type> <name>" << std::endl;
+        return false;
+    }
+    std::string type = words[0];
+    const std::string& name = words[1];
+
+    SamplerType samplerType;
+    if (lookup(SAMPLER_TYPES, type, samplerType)) {
+        SamplerFormat format = SamplerFormat::FLOAT;
+        Precision precision = Precision::MEDIUM;
+        if (words.size() > 2 && !lookup(SAMPLER_FORMATS, words[2], format)) {
+            Error() << "unknown sampler format " << words[2] << std::endl;
+            return false;
+        }
+        if (words.size() > 3 && !lookup(PRECISIONS, words[3], precision)) {
+            Error() << "unknown precision " << words[3] << std::endl;
+            return false;
+        }
+        return builder.AddParameter(samplerType, format, precision, name);
+    }
+
+    // arrays are declared as type[size]
+    size_t size = 1;
+    const size_t bracket = type.find('[');
+    if (bracket != std::string::npos) {
+        char* end = nullptr;
+        const long count = strtol(type.c_str() + bracket + 1, &end, 10);
+        if (count <= 0 || *end != ']' || end[1] != '\0') {
+            Error() << "invalid array size for " << name << std::endl;
+            return false;
+        }
+        size = size_t(count);
+        type = type.substr(0, bracket);
+    }
+    UniformType uniformType;
+    if (!lookup(UNIFORM_TYPES, type, uniformType)) {
+        Error() << "unknown parameter type " << type << std::endl;
+        return false;
+    }
+    if (words.size() > 2) {
+        Error() << "unexpected " << words[2] << " after " << name << std::endl;
+        return false;
+    }
+    if (!builder.AddParameter(uniformType, size, name)) {
+        return false;
+    }
+    if ((uniformType >= UniformType::FLOAT && uniformType <= UniformType::FLOAT4) ||
+            uniformType == UniformType::MAT3 || uniformType == UniformType::MAT4) {
+        mFloatParameters.push_back(name);
+    }
+    return true;
+}
+
+bool MaterialParser::ParseRange(const std::string& value, MaterialBuilder& builder)
+{
+    auto words = splitWords(value);
+    char* end0 = nullptr;
+    char* end1 = nullptr;
+    float min = 0.0f;
+    float max = 0.0f;
+    if (words.size() == 3) {
+        min = strtof(words[1].c_str(), &end0);
+        max = strtof(words[2].c_str(), &end1);
+    }
+    if (words.size() != 3 || *end0 != '\0' || *end1 != '\0' || min > max) {
+        Error() << "expected range = <parameter or variable> <min> <max>" << std::endl;
+        return false;
+    }
+
+    const std::string& name = words[0];
+    for (size_t i = 0; i < mVariables.size(); i++) {
+        if (mVariables[i] == name) {
+            builder.SetVariableRange(MaterialBuilder::Variable(i), min, max);
+            return true;
+        }
+    }
+    for (auto const& parameter : mFloatParameters) {
+        if (parameter == name) {
+            builder.SetParameterRange(name, min, max);
+            return true;
+        }
+    }
+    Error() << "no float parameter or variable " << name << " declared before the range"
+            << std::endl;
+    return false;
+}
+
+std::ostream& MaterialParser::Error()
+{
+    return mErr << mFilepath << ":" << mLine << ": error: ";
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "pbr/MaterialBuilder.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace pbr
+{
+
+// Reads a material definition into a MaterialBuilder. The format is INI like:
+//
+//   ; comment
+//   [material]
+//   name = brushed_metal
+//   shading = lit                   ; unlit, lit, subsurface, cloth, specularGlossiness
+//   blending = opaque               ; opaque, transparent, add, masked, fade, multiply, screen
+//   postLightingBlending = transparent
+//   interpolation = smooth          ; smooth, flat
+//   vertexDomain = object           ; object, world, view, device
+//   doubleSided = false             ; and shadowMultiplier, specularAntiAliasing,
+//                                   ; clearCoatIorChange, flipUV, multiBounceAO, specularAO,
+//                                   ; inferProperties, inferAttributes, precisionLowering,
+//                                   ; samplerArrays
+//   requires = uv0, color           ; added to the attributes inferred from the code, e.g.
+//                                   ; for a vertex layout shared with other materials
+//   properties = baseColor, roughness ; only with inferProperties = false, by default they
+//                                   ; are inferred from the [fragment] code
+//   variables = eyeDirection        ; up to 4 custom interpolants
+//   parameter = float3 tint
+//   parameter = float[4] weights
+//   parameter = sampler2d albedo    ; or samplerCubemap, samplerExternal, sampler2dArray,
+//                                   ; optional format (int, uint, float, shadow) and
+//   parameter = sampler2d mask float low   ; precision (low, medium, high)
+//   range = tint 0 1                ; values of a float parameter or variable, declared
+//                                   ; above, for precisionLowering
+//
+//   [fragment]
+//   void material(inout MaterialInputs material) {
+//       ...
+//   }
+//
+//   [vertex]
+//   ...
+//
+// The [fragment] and [vertex] sections hold GLSL up to the next section header, their line
+// numbers are kept in the generated programs.
+class MaterialParser
+{
+public:
+    MaterialParser(const std::string& filepath, std::ostream& err);
+
+    bool Parse(const std::string& text, MaterialBuilder& builder);
+
+private:
+    bool ParseProperty(const std::string& key, const std::string& value, MaterialBuilder& builder);
+    bool ParseParameter(const std::string& value, MaterialBuilder& builder);
+    bool ParseRange(const std::string& value, MaterialBuilder& builder);
+
+    std::ostream& Error();
+
+private:
+    std::string mFilepath;
+    std::ostream& mErr;
+    size_t mLine = 0;
+
+    // declared so far, for the ranges
+    std::vector<std::string> mFloatParameters;
+    std::vector<std::string> mVariables;
+
+}; // MaterialParser
+
+}
@@ -0,0 +1,418 @@
+// Batch material compiler. Compiles each material definition (see MaterialParser) into a
+// MaterialPackage, materials and their variants in parallel, and optionally writes a Make/Ninja
+// depfile next to each package so that build systems only recompile what changed.
+//
+// usage: pbrc [options] <material.mat | @list.txt>...
+
+#include "MaterialParser.h"
+
+#include "pbr/DescriptorLayout.h"
+#include "pbr/MaterialBuilder.h"
+#include "pbr/MaterialInfo.h"
+#include "pbr/MaterialPackage.h"
+#include "pbr/ShaderCache.h"
+#include "pbr/ShaderChunks.h"
+#include "pbr/ThreadPool.h"
+#include "pbr/Trace.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef PBR_SHADERS_DIR
+#define PBR_SHADERS_DIR "shaders"
+#endif
+
+namespace
+{
+
+using namespace pbr;
+
+struct Options
+{
+    std::string outputDir = ".";
+    std::string shadersDir = PBR_SHADERS_DIR;
+    std::string cacheDir;
+    const char* tracePath = nullptr;
+    size_t jobs = 0;
+    bool depfiles = false;
+    bool compress = false;
+    bool lineDictionary = false;
+    bool packUniforms = false;
+    bool opengl = true;
+    bool vulkan = false;
+    bool mobile = true;
+    bool desktop = true;
+    MaterialBuilder::Optimization optimization = MaterialBuilder::Optimization::PERFORMANCE;
+    MaterialBuilder::Minification minification = MaterialBuilder::Minification::NONE;
+};
+
+void printUsage()
+{
+    std::cerr <<
+        "usage: pbrc [options] <material.mat | @list.txt>...\n"
+        "\n"
+        "  -o <dir>                   output directory of the .pkg files, default .\n"
+        "  -j <N>                     worker threads, default one per hardware thread\n"
+        "  -a opengl|vulkan|all       target APIs, default opengl\n"
+        "  -p mobile|desktop|all      target platforms, default all\n"
+        "  -O none|performance|size   SPIR-V optimization, default performance\n"
+        "  --minify none|strip|rename GLSL minification, default none\n"
+        "  --compress                 lz compress the shader blobs\n"
+        "  --line-dictionary          store GLSL as lines of a shared dictionary\n"
+        "  --pack-uniforms            reorder the parameters to shrink their uniform block\n"
+        "  -d                         write a depfile <output>.d for each package\n"
+        "  --shaders <dir>            shader chunks listed in the depfiles, default "
+        PBR_SHADERS_DIR "\n"
+        "  --cache <dir>              persistent shader cache, must exist\n"
+        "  --trace <file.json>        write a Chrome trace of the build\n"
+        "\n"
+        "  @list.txt reads the materials from a file, one path per line.\n";
+}
+
+bool readFile(const std::string& filepath, std::string& text)
+{
+    std::ifstream fin(filepath, std::ios::binary);
+    if (!fin) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    text = ss.str();
+    return true;
+}
+
+std::string getStem(const std::string& filepath)
+{
+    const size_t slash = filepath.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? filepath : filepath.substr(slash + 1);
+    const size_t dot = name.find_last_of('.');
+    return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+std::string getOutputPath(const Options& options, const std::string& input)
+{
+    return options.outputDir + "/" + getStem(input) + ".pkg";
+}
+
+// Packages are named after their material, two inputs of the same name would write the same
+// file concurrently.
+bool checkOutputPaths(const Options& options, const std::vector<std::string>& inputs)
+{
+    std::unordered_map<std::string, const std::string*> outputs;
+    bool ok = true;
+    for (auto const& input : inputs) {
+        const std::string output = getOutputPath(options, input);
+        auto result = outputs.emplace(output, &input);
+        if (!result.second) {
+            std::cerr << "ERROR: " << *result.first->second << " and " << input
+                      << " both compile to " << output << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+const char* getPrecisionName(Precision precision)
+{
+    switch (precision) {
+    case Precision::LOW:     return "lowp";
+    case Precision::MEDIUM:  return "mediump";
+    case Precision::HIGH:    return "highp";
+    case Precision::DEFAULT: return "default";
+    }
+    return "";
+}
+
+// Make syntax: forward slashes, escaped spaces and dollars.
+std::string toDepPath(const std::string& filepath)
+{
+    std::string path;
+    for (char c : filepath) {
+        if (c == '\\') {
+            path += '/';
+        } else if (c == ' ') {
+            path += "\\ ";
+        } else if (c == '$') {
+            path += "$$";
+        } else if (c == '#') {
+            path += "\\#";
+        } else {
+            path += c;
+        }
+    }
+    return path;
+}
+
+// Every program key hashes all the chunks (see ShaderChunks::GetHash()), so each package
+// depends on all of them along with its material source.
+bool writeDepfile(const std::string& output, const std::string& input,
+                  const std::string& shadersDir)
+{
+    std::ofstream fout(output + ".d");
+    if (!fout) {
+        return false;
+    }
+    fout << toDepPath(output) << ": " << toDepPath(input);
+    const ShaderChunk* chunks = ShaderChunks::GetAll();
+    for (size_t i = 0; i < size_t(ShaderChunkId::COUNT); i++) {
+        fout << " \\\n  " << toDepPath(shadersDir + "/" + chunks[i].file);
+    }
+    fout << "\n";
+    return bool(fout);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options, std::vector<std::string>& inputs)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "-o") && hasValue) {
+            options.outputDir = argv[++i];
+        } else if (!strcmp(arg, "-j") && hasValue) {
+            options.jobs = size_t(std::max(0, atoi(argv[++i])));
+        } else if (!strcmp(arg, "-a") && hasValue) {
+            const std::string api = argv[++i];
+            options.opengl = api == "opengl" || api == "all";
+            options.vulkan = api == "vulkan" || api == "all";
+            if (!options.opengl && !options.vulkan) {
+                return false;
+            }
+        } else if (!strcmp(arg, "-p") && hasValue) {
+            const std::string platform = argv[++i];
+            options.mobile = platform == "mobile" || platform == "all";
+            options.desktop = platform == "desktop" || platform == "all";
+            if (!options.mobile && !options.desktop) {
+                return false;
+            }
+        } else if (!strcmp(arg, "-O") && hasValue) {
+            const std::string level = argv[++i];
+            if (level == "none") {
+                options.optimization = MaterialBuilder::Optimization::NONE;
+            } else if (level == "performance") {
+                options.optimization = MaterialBuilder::Optimization::PERFORMANCE;
+            } else if (level == "size") {
+                options.optimization = MaterialBuilder::Optimization::SIZE;
+            } else {
+                return false;
+            }
+        } else if (!strcmp(arg, "--minify") && hasValue) {
+            const std::string level = argv[++i];
+            if (level == "none") {
+                options.minification = MaterialBuilder::Minification::NONE;
+            } else if (level == "strip") {
+                options.minification = MaterialBuilder::Minification::STRIP;
+            } else if (level == "rename") {
+                options.minification = MaterialBuilder::Minification::STRIP_AND_RENAME;
+            } else {
+                return false;
+            }
+        } else if (!strcmp(arg, "--compress")) {
+            options.compress = true;
+        } else if (!strcmp(arg, "--line-dictionary")) {
+            options.lineDictionary = true;
+        } else if (!strcmp(arg, "--pack-uniforms")) {
+            options.packUniforms = true;
+        } else if (!strcmp(arg, "-d")) {
+            options.depfiles = true;
+        } else if (!strcmp(arg, "--shaders") && hasValue) {
+            options.shadersDir = argv[++i];
+        } else if (!strcmp(arg, "--cache") && hasValue) {
+            options.cacheDir = argv[++i];
+        } else if (!strcmp(arg, "--trace") && hasValue) {
+            options.tracePath = argv[++i];
+        } else if (arg[0] == '@') {
+            std::ifstream fin(arg + 1);
+            if (!fin) {
+                std::cerr << "ERROR: Unable to read " << arg + 1 << std::endl;
+                return false;
+            }
+            std::string line;
+            while (std::getline(fin, line)) {
+                while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+                    line.pop_back();
+                }
+                if (!line.empty()) {
+                    inputs.push_back(line);
+                }
+            }
+        } else if (arg[0] == '-') {
+            return false;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    return !inputs.empty();
+}
+
+std::vector<MaterialBuilder::CodeGenParams> getCodeGenParams(const Options& options)
+{
+    std::vector<MaterialBuilder::CodeGenParams> params;
+    auto add = [&](ShaderModel model, MaterialBuilder::TargetApi api,
+                   MaterialBuilder::TargetLanguage language) {
+        MaterialBuilder::CodeGenParams p = { model, api, language };
+        p.optimization = options.optimization;
+        p.minification = options.minification;
+        params.push_back(p);
+    };
+    const ShaderModel models[] = { ShaderModel::GL_ES_30, ShaderModel::GL_CORE_41 };
+    for (auto model : models)
+    {
+        const bool mobile = model == ShaderModel::GL_ES_30;
+        if ((mobile && !options.mobile) || (!mobile && !options.desktop)) {
+            continue;
+        }
+        if (options.opengl) {
+            add(model, MaterialBuilder::TargetApi::OPENGL, MaterialBuilder::TargetLanguage::GLSL);
+        }
+        if (options.vulkan) {
+            add(model, MaterialBuilder::TargetApi::VULKAN, MaterialBuilder::TargetLanguage::SPIRV);
+        }
+    }
+    return params;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    std::vector<std::string> inputs;
+    if (!parseOptions(argc, argv, options, inputs)) {
+        printUsage();
+        return 1;
+    }
+    if (!checkOutputPaths(options, inputs)) {
+        return 1;
+    }
+
+    pbr::Trace::Enable(options.tracePath != nullptr);
+
+    std::unique_ptr<ShaderCache> cache;
+    if (!options.cacheDir.empty()) {
+        cache.reset(new ShaderCache(options.cacheDir));
+    }
+
+    const std::vector<MaterialBuilder::CodeGenParams> params = getCodeGenParams(options);
+
+    // Materials run on the pool and their variants run nested on the same pool, so that a batch
+    // of one large material still uses every thread.
+    ThreadPool pool(options.jobs);
+    // the Vulkan descriptor-set layouts, shared by the materials with identical ones
+    DescriptorLayoutCache layouts;
+    std::mutex outputLock;
+    std::atomic<size_t> failures(0);
+    pool.ParallelFor(inputs.size(), [&](size_t i) {
+        const std::string& input = inputs[i];
+        // errors are collected per material so that concurrent builds don't interleave them
+        std::stringstream err;
+        auto fail = [&]() {
+            std::lock_guard<std::mutex> lock(outputLock);
+            std::cerr << err.str();
+            failures++;
+        };
+
+        std::string text;
+        if (!readFile(input, text)) {
+            err << "ERROR: Unable to read " << input << std::endl;
+            fail();
+            return;
+        }
+
+        MaterialBuilder builder;
+        builder.SetName(getStem(input));
+        MaterialParser parser(input, err);
+        if (!parser.Parse(text, builder)) {
+            fail();
+            return;
+        }
+        builder.SetShaderCache(cache.get());
+        builder.SetUniformPacking(options.packUniforms);
+
+        MaterialBuilder::ShaderOutputList shaders;
+        if (!builder.Build(pool, params, shaders)) {
+            err << input << ": error: failed to build " << builder.GetName() << std::endl;
+            fail();
+            return;
+        }
+
+        MaterialInfo info;
+        builder.GetMaterialInfo(info);
+        MaterialPackageWriter writer(builder.GetName(), info);
+        writer.SetCompression(options.compress);
+        writer.SetLineDictionary(options.lineDictionary);
+        writer.AddShaders(shaders);
+
+        const std::string output = getOutputPath(options, input);
+        if (!writer.WriteFile(output)) {
+            err << "ERROR: Unable to write " << output << std::endl;
+            fail();
+            return;
+        }
+        if (options.depfiles && !writeDepfile(output, input, options.shadersDir)) {
+            err << "ERROR: Unable to write " << output << ".d" << std::endl;
+            fail();
+            return;
+        }
+
+        uint32_t layoutIds[DescriptorLayout::SET_COUNT];
+        if (options.vulkan) {
+            DescriptorLayout layout(info);
+            for (uint32_t set = 0; set < DescriptorLayout::SET_COUNT; set++) {
+                layoutIds[set] = layouts.GetId(layout.GetSet(set));
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(outputLock);
+        std::cout << input << " -> " << output << " (" << writer.GetShaderCount()
+                  << " programs, " << writer.GetBlobCount() << " unique)" << std::endl;
+        if (options.vulkan) {
+            std::cout << "  descriptor set layouts:";
+            for (uint32_t set = 0; set < DescriptorLayout::SET_COUNT; set++) {
+                std::cout << " #" << layoutIds[set];
+            }
+            std::cout << std::endl;
+        }
+        if (options.packUniforms) {
+            info.uib.printLayout(std::cout);
+        }
+        for (auto const& change : builder.GetPrecisionChanges()) {
+            std::cout << "  " << (change.isVariable ? "variable " : "parameter ") << change.name
+                      << ": " << getPrecisionName(change.from) << " -> "
+                      << getPrecisionName(change.to) << " (" << change.reason << ")" << std::endl;
+        }
+    });
+
+    if (options.vulkan) {
+        std::cout << "descriptor set layouts: " << layouts.GetSize() << " unique" << std::endl;
+        for (size_t id = 0; id < layouts.GetSize(); id++) {
+            std::cout << "  #" << id << " ";
+            layouts.GetLayout(uint32_t(id)).Print(std::cout);
+            std::cout << std::endl;
+        }
+    }
+    if (cache) {
+        std::cout << "shader cache: " << cache->GetHitCount() << " hits, "
+                  << cache->GetMissCount() << " misses" << std::endl;
+    }
+    if (options.tracePath) {
+        pbr::Trace::PrintSummary(std::cout);
+        pbr::Trace::WriteChromeTrace(options.tracePath);
+    }
+
+    if (failures) {
+        std::cerr << failures << " of " << inputs.size() << " material(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}